@@ -0,0 +1,251 @@
+﻿/*
+    Сравнение оптимизированных реализаций с эталонными на случайных
+    изображениях: удаление шума - с последовательной заливкой областей,
+    битовая и серийная морфология - с морфологией OpenCV, инкрементальный
+    поиск контуров - с полным поиском. Возвращает 1 при любом расхождении.
+
+    Запуск: ConsistencyCheck [количество итераций]
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <opencv2/imgproc.hpp>
+
+#include <BitMask.h>
+#include <Contour.h>
+#include <RunMask.h>
+#include <deletenoise.h>
+
+using namespace std;
+using namespace cv;
+
+// Случайная бинарная маска со значениями 0 и 255 заданной плотности (в процентах).
+static Mat makeRandomMask(int rows, int cols, int density, RNG& generator)
+{
+    Mat mask(rows, cols, CV_8UC1);
+    for (int y = 0; y < mask.rows; ++y)
+    {
+        uchar* row = mask.ptr(y);
+        for (int x = 0; x < mask.cols; ++x)
+            row[x] = (generator.uniform(0, 100) < density) ? 255 : 0;
+    }
+    return mask;
+}
+
+// Количество различающихся пикселей двух масок одного размера.
+static int countDifferences(const Mat& first, const Mat& second)
+{
+    if (first.size() != second.size())
+        return first.rows * first.cols + 1;
+
+    int differences = 0;
+    for (int y = 0; y < first.rows; ++y)
+    {
+        const uchar* a = first.ptr(y);
+        const uchar* b = second.ptr(y);
+        for (int x = 0; x < first.cols; ++x)
+            differences += (a[x] != b[x]);
+    }
+    return differences;
+}
+
+// Заменяет на replacement все 4-связные области значения value
+// площадью меньше min_area.
+static void fillSmallRegions(Mat& image, uchar value, uchar replacement, int min_area)
+{
+    Mat visited = Mat::zeros(image.size(), CV_8UC1);
+    vector<Point> region;
+    for (int y = 0; y < image.rows; ++y)
+    {
+        for (int x = 0; x < image.cols; ++x)
+        {
+            if (image.at<uchar>(y, x) != value || visited.at<uchar>(y, x))
+                continue;
+
+            region.clear();
+            region.push_back(Point(x, y));
+            visited.at<uchar>(y, x) = 1;
+            for (size_t i = 0; i < region.size(); ++i)
+            {
+                const Point neighbors[4] = { region[i] + Point(-1, 0), region[i] + Point(1, 0),
+                                             region[i] + Point(0, -1), region[i] + Point(0, 1) };
+                for (const Point& point : neighbors)
+                {
+                    if (point.x < 0 || point.y < 0 || point.x >= image.cols || point.y >= image.rows)
+                        continue;
+                    if (image.at<uchar>(point) != value || visited.at<uchar>(point))
+                        continue;
+                    visited.at<uchar>(point) = 1;
+                    region.push_back(point);
+                }
+            }
+
+            if ((int)region.size() < min_area)
+                for (const Point& point : region)
+                    image.at<uchar>(point) = replacement;
+        }
+    }
+    return;
+}
+
+// Эталон deleteNoise: сначала заливаются мелкие дыры, затем удаляются мелкие объекты.
+static void deleteNoiseReference(Mat& image, int min_fg_area, int min_bg_area)
+{
+    if (min_bg_area > 0)
+        fillSmallRegions(image, 0, 255, min_bg_area);
+    if (min_fg_area > 0)
+        fillSmallRegions(image, 255, 0, min_fg_area);
+    return;
+}
+
+static int checkDeleteNoise(RNG& generator)
+{
+    Mat mask = makeRandomMask(generator.uniform(1, 160), generator.uniform(1, 160),
+                              generator.uniform(1, 99), generator);
+    const int min_fg_area = generator.uniform(0, 40);
+    const int min_bg_area = generator.uniform(0, 40);
+
+    Mat reference = mask.clone();
+    deleteNoiseReference(reference, min_fg_area, min_bg_area);
+    deleteNoise(mask, min_fg_area, min_bg_area);
+    return countDifferences(mask, reference);
+}
+
+static int checkMorphology(RNG& generator)
+{
+    Mat mask = makeRandomMask(generator.uniform(1, 60), generator.uniform(1, 200),
+                              generator.uniform(1, 99), generator);
+    const Size kernel_size(generator.uniform(1, 6), generator.uniform(1, 6));
+    const Mat kernel = Mat::ones(kernel_size, CV_8UC1);
+    const Mat cross = getStructuringElement(MORPH_CROSS, Size(3, 3));
+    const int iterations = generator.uniform(1, 6);
+
+    int differences = 0;
+    Mat reference, result;
+
+    erode(mask, reference, kernel);
+    BitMask eroded(mask);
+    eroded.erode(kernel_size);
+    eroded.toMat(result);
+    differences += countDifferences(result, reference);
+
+    dilate(mask, reference, kernel);
+    BitMask dilated(mask);
+    dilated.dilate(kernel_size);
+    dilated.toMat(result);
+    differences += countDifferences(result, reference);
+
+    morphologyEx(mask, reference, MORPH_OPEN, kernel);
+    BitMask opened(mask);
+    opened.open(kernel_size);
+    opened.toMat(result);
+    differences += countDifferences(result, reference);
+
+    erode(mask, reference, cross, Point(-1, -1), iterations);
+    BitMask cross_eroded(mask);
+    cross_eroded.erodeCross(iterations);
+    cross_eroded.toMat(result);
+    differences += countDifferences(result, reference);
+
+    dilate(mask, reference, cross, Point(-1, -1), iterations);
+    BitMask cross_dilated(mask);
+    cross_dilated.dilateCross(iterations);
+    cross_dilated.toMat(result);
+    differences += countDifferences(result, reference);
+
+    RunMask runs(mask);
+    runs.dilateCross(iterations);
+    runs.toMat(result);
+    differences += countDifferences(result, reference);
+
+    return differences;
+}
+
+// Количество контуров, различающихся в двух наборах.
+static int countContourDifferences(const ContourStore& first, const ContourStore& second)
+{
+    if (first.size() != second.size())
+        return 1 + (int)max(first.size(), second.size());
+
+    int differences = 0;
+    for (size_t i = 0; i < first.size(); ++i)
+    {
+        const Contour a = first[i];
+        const Contour b = second[i];
+        bool equal = (a.getStart() == b.getStart()) && (a.size() == b.size());
+        for (size_t k = 0; equal && k + 1 < a.size(); ++k)
+            equal = (a.getCode(k) == b.getCode(k));
+        differences += !equal;
+    }
+    return differences;
+}
+
+// Последовательность кадров с движущимся объектом и точечным шумом:
+// контуры, найденные инкрементально, сравниваются с полным поиском.
+static int checkIncrementalContours(RNG& generator)
+{
+    const int rows = generator.uniform(20, 200);
+    const int cols = generator.uniform(20, 200);
+    const int tile_size = generator.uniform(4, 40);
+
+    Mat background = Mat::zeros(rows, cols, CV_8UC1);
+    for (int i = 0; i < 6; ++i)
+        circle(background, Point(generator.uniform(0, cols), generator.uniform(0, rows)),
+               generator.uniform(2, 25), Scalar(255), FILLED);
+
+    int differences = 0;
+    Mat previous_image, changed;
+    vector<Rect> previous_excluded;
+    ContourStore previous, current, full;
+    for (int frame = 0; frame < 10; ++frame)
+    {
+        Mat image = background.clone();
+        circle(image, Point(frame * 7 % cols, rows / 2), 8, Scalar(255), FILLED);
+        for (int i = 0; i < 5; ++i)
+            image.at<uchar>(generator.uniform(0, rows), generator.uniform(0, cols)) ^= 255;
+
+        vector<Rect> excluded;
+        if (generator.uniform(0, 3) == 0)
+            excluded.push_back(Rect(generator.uniform(0, cols), generator.uniform(0, rows), 20, 20));
+
+        extractContours(image, excluded, full);
+        if (frame == 0)
+            extractContours(image, excluded, current);
+        else
+        {
+            findChangedTiles(previous_image, previous_excluded, image, excluded, tile_size, changed);
+            extractContours(image, excluded, previous, changed, tile_size, current);
+        }
+        differences += countContourDifferences(current, full);
+
+        previous_image = image;
+        previous_excluded = excluded;
+        swap(previous, current);
+    }
+    return differences;
+}
+
+int main(int argc, char** argv)
+{
+    const int iterations = (argc > 1) ? atoi(argv[1]) : 50;
+    if (iterations <= 0)
+    {
+        printf("No iterations to run.\n");
+        return 1;
+    }
+
+    RNG generator(0x5eed);
+    int noise_errors = 0, morphology_errors = 0, contour_errors = 0;
+    for (int i = 0; i < iterations; ++i)
+    {
+        noise_errors += checkDeleteNoise(generator);
+        morphology_errors += checkMorphology(generator);
+        contour_errors += checkIncrementalContours(generator);
+    }
+
+    printf("deleteNoise:      %d mismatches\n", noise_errors);
+    printf("morphology:       %d mismatches\n", morphology_errors);
+    printf("contours:         %d mismatches\n", contour_errors);
+    return (noise_errors || morphology_errors || contour_errors) ? 1 : 0;
+}
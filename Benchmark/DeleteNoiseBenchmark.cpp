@@ -0,0 +1,71 @@
+﻿/*
+    Время удаления шума с маски движения в зависимости от количества
+    мелких объектов на ней: среднее и максимальное время на кадр.
+
+    Запуск: DeleteNoiseBenchmark [количество кадров]
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <opencv2/imgproc.hpp>
+
+#include <deletenoise.h>
+#include <Timer.h>
+
+using namespace std;
+using namespace cv;
+
+// Маска: крупный объект и точечный шум заданной плотности (в процентах).
+static Mat makeNoisyMask(int density, RNG& generator)
+{
+    Mat mask(480, 640, CV_8UC1);
+    for (int y = 0; y < mask.rows; ++y)
+    {
+        uchar* row = mask.ptr(y);
+        for (int x = 0; x < mask.cols; ++x)
+            row[x] = (generator.uniform(0, 100) < density) ? 255 : 0;
+    }
+
+    rectangle(mask, Rect(200, 120, 160, 240), Scalar(255), FILLED);
+    return mask;
+}
+
+int main(int argc, char** argv)
+{
+    const int frames_number = (argc > 1) ? atoi(argv[1]) : 100;
+    if (frames_number <= 0)
+    {
+        printf("No frames to process.\n");
+        return 1;
+    }
+
+    const int densities[] = { 0, 1, 5, 20, 35, 50 };
+
+    printf("Frames: %d, size: 640x480\n", frames_number);
+    printf("%-10s %12s %12s\n", "Noise,%", "ms/frame", "max ms");
+
+    RNG generator(0);
+    for (int density : densities)
+    {
+        double total = 0, maximum = 0;
+        for (int i = 0; i < frames_number; ++i)
+        {
+            Mat mask = makeNoisyMask(density, generator);
+
+            Timer timer;
+            timer.start();
+            deleteNoise(mask, 100, 200);
+            timer.stop();
+
+            const double time = timer.getTime();
+            total += time;
+            if (time > maximum)
+                maximum = time;
+        }
+
+        printf("%-10d %12.3f %12.3f\n", density,
+               1000.0 * total / frames_number, 1000.0 * maximum);
+    }
+
+    return 0;
+}
@@ -0,0 +1,173 @@
+﻿/*
+    Сравнение вариантов модели ViBe+: объём памяти, скорость работы
+    и совпадение масок движения с полноцветной полноразмерной моделью.
+
+    Запуск: ViBeBenchmark [видеофайл] [количество кадров]
+    Без видеофайла используется синтетическая последовательность.
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/videoio.hpp>
+
+#include <ViBe_plus.h>
+#include <Timer.h>
+
+using namespace std;
+using namespace cv;
+
+// Синтетический кадр: зашумлённый градиентный фон и движущийся прямоугольник.
+static Mat makeSyntheticFrame(int index, RNG& generator)
+{
+    Mat frame(480, 640, CV_8UC3);
+    for (int y = 0; y < frame.rows; ++y)
+    {
+        uchar* row = frame.ptr(y);
+        for (int x = 0; x < frame.cols; ++x)
+        {
+            row[3 * x]     = saturate_cast<uchar>(x / 4 + generator.uniform(-6, 7));
+            row[3 * x + 1] = saturate_cast<uchar>(y / 3 + generator.uniform(-6, 7));
+            row[3 * x + 2] = saturate_cast<uchar>(96 + generator.uniform(-6, 7));
+        }
+    }
+
+    const int x = (index * 7) % (frame.cols - 120);
+    rectangle(frame, Rect(x, 150, 120, 180), Scalar(40, 170, 220), FILLED);
+    return frame;
+}
+
+static vector<Mat> loadFrames(int argc, char** argv)
+{
+    const int frames_number = (argc > 2) ? atoi(argv[2]) : 200;
+    vector<Mat> frames;
+
+    if (argc > 1)
+    {
+        VideoCapture video(argv[1]);
+        Mat frame;
+        while (((int)frames.size() < frames_number) && video.read(frame))
+            frames.push_back(frame.clone());
+    }
+    else
+    {
+        RNG generator(0);
+        for (int i = 0; i < frames_number; ++i)
+            frames.push_back(makeSyntheticFrame(i, generator));
+    }
+
+    return frames;
+}
+
+// Счётчики совпадения масок движения.
+struct MaskAgreement
+{
+    double equal = 0; // Точки с одинаковой классификацией.
+    double intersection = 0; // Точки переднего плана в обеих масках.
+    double united = 0; // Точки переднего плана хотя бы в одной маске.
+    double total = 0; // Все точки.
+};
+
+static void compareMasks(const Mat& mask, const Mat& reference, MaskAgreement& agreement)
+{
+    for (int y = 0; y < mask.rows; ++y)
+    {
+        const uchar* row = mask.ptr(y);
+        const uchar* reference_row = reference.ptr(y);
+        for (int x = 0; x < mask.cols; ++x)
+        {
+            const bool fg = row[x] != 0, reference_fg = reference_row[x] != 0;
+            agreement.equal += (fg == reference_fg);
+            agreement.intersection += (fg && reference_fg);
+            agreement.united += (fg || reference_fg);
+        }
+    }
+    agreement.total += (double)mask.total();
+
+    return;
+}
+
+// Результат работы одного варианта модели.
+struct ModelResult
+{
+    size_t memory;
+    double time;
+    double skipped; // Доля пропущенных блоков карты активности.
+    vector<Mat> masks;
+};
+
+// Вариант модели.
+struct ModelConfig
+{
+    const char* name;
+    ViBeModel model;
+    int scale;
+    int tile_size; // Размер блока карты активности, 0 - без пропуска блоков.
+};
+
+static ModelResult runModel(const ModelConfig& config, const vector<Mat>& frames)
+{
+    ModelResult result;
+    ViBe_plus motion(20, 20, 2, 15, config.model, config.scale);
+    motion.setParallelism(getNumThreads(), 0);
+    motion.setActivityGate(config.tile_size, 20);
+
+    Timer timer;
+    for (const Mat& frame : frames)
+    {
+        Mat fgmask(frame.size(), CV_8UC1);
+        timer.start();
+        motion.apply(frame, fgmask, 1.0 / 15);
+        timer.stop();
+        result.masks.push_back(fgmask);
+    }
+
+    result.memory = motion.getModelMemory();
+    result.time = timer.getTime();
+    result.skipped = motion.getSkippedTileFraction();
+    return result;
+}
+
+int main(int argc, char** argv)
+{
+    const vector<Mat> frames = loadFrames(argc, argv);
+    if (frames.empty())
+    {
+        printf("No frames to process.\n");
+        return 1;
+    }
+
+    const ModelConfig configs[] = { { "Color",   ViBeModel::Color,   1, 0 },
+                                    { "Luma",    ViBeModel::Luma,    1, 0 },
+                                    { "Compact", ViBeModel::Compact, 1, 0 },
+                                    { "Color/2", ViBeModel::Color,   2, 0 },
+                                    { "Luma/2",  ViBeModel::Luma,    2, 0 },
+                                    { "Color+T", ViBeModel::Color,   1, 32 } };
+
+    printf("Frames: %d, size: %dx%d\n", (int)frames.size(), frames[0].cols, frames[0].rows);
+    printf("%-8s %12s %12s %12s %12s %12s\n", "Model", "Memory, MB", "ms/frame",
+           "Agreement,%", "FG IoU,%", "Skipped,%");
+
+    ModelResult reference;
+    for (size_t i = 0; i < sizeof(configs) / sizeof(configs[0]); ++i)
+    {
+        ModelResult result = runModel(configs[i], frames);
+        if (i == 0)
+            reference = result;
+
+        // Совпадение масок с полноцветной моделью.
+        MaskAgreement agreement;
+        for (size_t j = 0; j < frames.size(); ++j)
+            compareMasks(result.masks[j], reference.masks[j], agreement);
+
+        printf("%-8s %12.2f %12.3f %12.2f %12.2f %12.2f\n", configs[i].name,
+               result.memory / (1024.0 * 1024.0),
+               1000.0 * result.time / frames.size(),
+               100.0 * agreement.equal / agreement.total,
+               (agreement.united > 0) ? 100.0 * agreement.intersection / agreement.united : 100.0,
+               100.0 * result.skipped);
+    }
+
+    return 0;
+}
@@ -0,0 +1,343 @@
+﻿/*
+    Реализация бинарной маски, упакованной по одному биту на точку.
+*/
+
+#include <algorithm>
+#include <bitset>
+#include <opencv2/core/hal/intrin.hpp>
+
+#include <BitMask.h>
+
+using namespace cv;
+using namespace std;
+
+const uchar BackGround = 0;
+const uchar ForeGround = 255;
+
+const int WordBits = 64;
+const uint64 EmptyWord = 0;
+const uint64 FullWord = ~EmptyWord;
+
+// Слово строки с номером index, слова за пределами строки равны outside.
+static inline uint64 getWord(const uint64* row, int words, int index, uint64 outside)
+{
+    return ((index < 0) || (index >= words)) ? outside : row[index];
+}
+
+// Сдвиг строки: в точку x записывается точка x + shift исходной строки.
+static void shiftRow(const uint64* src, int words, int shift, uint64 outside, uint64* dst)
+{
+    const int word_shift = (shift >= 0) ? shift / WordBits : -((WordBits - 1 - shift) / WordBits);
+    const int bit_shift = shift - word_shift * WordBits;
+    for (int k = 0; k < words; ++k)
+    {
+        const uint64 low = getWord(src, words, k + word_shift, outside);
+        if (bit_shift == 0)
+        {
+            dst[k] = low;
+            continue;
+        }
+
+        const uint64 high = getWord(src, words, k + word_shift + 1, outside);
+        dst[k] = (low >> bit_shift) | (high << (WordBits - bit_shift));
+    }
+
+    return;
+}
+
+// Поразрядная операция над словами строк.
+enum class BitOperation
+{
+    And,
+    Or,
+    Xor
+};
+
+template <typename T>
+static inline T applyOperation(const T& a, const T& b, BitOperation operation)
+{
+    switch (operation)
+    {
+        case BitOperation::And:
+            return a & b;
+        case BitOperation::Or:
+            return a | b;
+        default:
+            return a ^ b;
+    }
+}
+
+// Записывает в строку dst результат операции над строками dst и src.
+static void combineRows(uint64* dst, const uint64* src, int words, BitOperation operation)
+{
+    int k = 0;
+#if CV_SIMD
+    for (; k <= words - v_uint64::nlanes; k += v_uint64::nlanes)
+        v_store(dst + k, applyOperation(v_load(dst + k), v_load(src + k), operation));
+#endif // CV_SIMD
+    for (; k < words; ++k)
+        dst[k] = applyOperation(dst[k], src[k], operation);
+
+    return;
+}
+
+BitMask::BitMask()
+:size_(), words_(0), data_()
+{
+}
+
+BitMask::BitMask(const Size& size)
+:BitMask()
+{
+    create(size);
+}
+
+BitMask::BitMask(const Mat& image)
+:BitMask()
+{
+    fromMat(image);
+}
+
+void BitMask::create(const Size& size)
+{
+    size_ = size;
+    words_ = (size.width + WordBits - 1) / WordBits;
+    data_.assign((size_t)words_ * size.height, EmptyWord);
+    return;
+}
+
+void BitMask::fromMat(const Mat& image)
+{
+    CV_Assert(image.type() == CV_8UC1);
+
+    create(image.size());
+    for (int y = 0; y < size_.height; ++y)
+    {
+        const uchar* src = image.ptr(y);
+        uint64* dst = row(y);
+        for (int k = 0; k < words_; ++k)
+        {
+            const int x_begin = k * WordBits;
+            const int x_end = std::min(x_begin + WordBits, size_.width);
+            uint64 word = EmptyWord;
+            for (int x = x_begin; x < x_end; ++x)
+                word |= (uint64)(src[x] == ForeGround) << (x - x_begin);
+
+            dst[k] = word;
+        }
+    }
+
+    return;
+}
+
+void BitMask::toMat(Mat& image) const
+{
+    image.create(size_, CV_8UC1);
+    for (int y = 0; y < size_.height; ++y)
+    {
+        const uint64* src = row(y);
+        uchar* dst = image.ptr(y);
+        for (int x = 0; x < size_.width; ++x)
+            dst[x] = ((src[x / WordBits] >> (x % WordBits)) & 1) ? ForeGround : BackGround;
+    }
+
+    return;
+}
+
+Size BitMask::size() const
+{
+    return size_;
+}
+
+bool BitMask::empty() const
+{
+    return size_.area() == 0;
+}
+
+int BitMask::getWordsPerRow() const
+{
+    return words_;
+}
+
+const uint64* BitMask::row(int y) const
+{
+    return data_.data() + (size_t)y * words_;
+}
+
+uint64* BitMask::row(int y)
+{
+    return data_.data() + (size_t)y * words_;
+}
+
+bool BitMask::get(int y, int x) const
+{
+    return (row(y)[x / WordBits] >> (x % WordBits)) & 1;
+}
+
+void BitMask::set(int y, int x, bool value)
+{
+    const uint64 bit = (uint64)1 << (x % WordBits);
+    uint64& word = row(y)[x / WordBits];
+    word = value ? (word | bit) : (word & ~bit);
+    return;
+}
+
+int BitMask::countNonZero() const
+{
+    int counter = 0;
+    for (uint64 word : data_)
+        counter += (int)bitset<WordBits>(word).count();
+
+    return counter;
+}
+
+BitMask& BitMask::operator&=(const BitMask& other)
+{
+    CV_Assert(other.size_ == size_);
+    combineRows(data_.data(), other.data_.data(), (int)data_.size(), BitOperation::And);
+    return *this;
+}
+
+BitMask& BitMask::operator|=(const BitMask& other)
+{
+    CV_Assert(other.size_ == size_);
+    combineRows(data_.data(), other.data_.data(), (int)data_.size(), BitOperation::Or);
+    return *this;
+}
+
+BitMask& BitMask::operator^=(const BitMask& other)
+{
+    CV_Assert(other.size_ == size_);
+    combineRows(data_.data(), other.data_.data(), (int)data_.size(), BitOperation::Xor);
+    return *this;
+}
+
+void BitMask::erode(const Size& kernel, bool border_foreground)
+{
+    applyKernel(kernel, true, border_foreground);
+    return;
+}
+
+void BitMask::dilate(const Size& kernel)
+{
+    applyKernel(kernel, false, false);
+    return;
+}
+
+void BitMask::erodeCross(int iterations, bool border_foreground)
+{
+    for (int i = 0; i < iterations; ++i)
+        applyCross(true, border_foreground);
+
+    return;
+}
+
+void BitMask::dilateCross(int iterations)
+{
+    for (int i = 0; i < iterations; ++i)
+        applyCross(false, false);
+
+    return;
+}
+
+void BitMask::open(const Size& kernel)
+{
+    erode(kernel);
+    dilate(kernel);
+    return;
+}
+
+void BitMask::clearPadding(uint64* row) const
+{
+    const int tail = size_.width % WordBits;
+    if ((words_ > 0) && (tail != 0))
+        row[words_ - 1] &= ((uint64)1 << tail) - 1;
+
+    return;
+}
+
+void BitMask::applyKernel(const Size& kernel, bool erosion, bool border_foreground)
+{
+    // Точки за границей маски влияют только на эрозию. Ядро разделимо:
+    // сначала объединяются сдвиги строки, затем соседние строки.
+    const uint64 outside = (erosion && border_foreground) ? FullWord : EmptyWord;
+    const uint64 identity = erosion ? FullWord : EmptyWord;
+    const BitOperation operation = erosion ? BitOperation::And : BitOperation::Or;
+    const int anchor_x = kernel.width / 2, anchor_y = kernel.height / 2;
+    const int tail = size_.width % WordBits;
+
+    BitMask horizontal(size_);
+    vector<uint64> padded(words_), shifted(words_);
+    for (int y = 0; y < size_.height; ++y)
+    {
+        // Биты за пределами строки получают значение внешних точек.
+        padded.assign(row(y), row(y) + words_);
+        if ((words_ > 0) && (tail != 0) && (outside != EmptyWord))
+            padded[words_ - 1] |= ~(((uint64)1 << tail) - 1);
+
+        uint64* dst = horizontal.row(y);
+        std::fill(dst, dst + words_, identity);
+        for (int j = 0; j < kernel.width; ++j)
+        {
+            shiftRow(padded.data(), words_, j - anchor_x, outside, shifted.data());
+            combineRows(dst, shifted.data(), words_, operation);
+        }
+
+        clearPadding(dst);
+    }
+
+    for (int y = 0; y < size_.height; ++y)
+    {
+        uint64* dst = row(y);
+        std::fill(dst, dst + words_, identity);
+        for (int i = 0; i < kernel.height; ++i)
+        {
+            const int source = y + i - anchor_y;
+            if ((source >= 0) && (source < size_.height))
+                combineRows(dst, horizontal.row(source), words_, operation);
+            else if (erosion && !border_foreground)
+                std::fill(dst, dst + words_, EmptyWord);
+        }
+    }
+
+    return;
+}
+
+void BitMask::applyCross(bool erosion, bool border_foreground)
+{
+    const uint64 outside = (erosion && border_foreground) ? FullWord : EmptyWord;
+    const uint64 identity = erosion ? FullWord : EmptyWord;
+    const BitOperation operation = erosion ? BitOperation::And : BitOperation::Or;
+    const int tail = size_.width % WordBits;
+
+    const BitMask source(*this);
+    vector<uint64> padded(words_), shifted(words_);
+    for (int y = 0; y < size_.height; ++y)
+    {
+        padded.assign(source.row(y), source.row(y) + words_);
+        if ((words_ > 0) && (tail != 0) && (outside != EmptyWord))
+            padded[words_ - 1] |= ~(((uint64)1 << tail) - 1);
+
+        // Центральная строка креста - три соседние точки.
+        uint64* dst = row(y);
+        std::fill(dst, dst + words_, identity);
+        for (int shift = -1; shift <= 1; ++shift)
+        {
+            shiftRow(padded.data(), words_, shift, outside, shifted.data());
+            combineRows(dst, shifted.data(), words_, operation);
+        }
+
+        // Верхняя и нижняя точки креста.
+        for (int neibor = y - 1; neibor <= y + 1; neibor += 2)
+        {
+            if ((neibor >= 0) && (neibor < size_.height))
+                combineRows(dst, source.row(neibor), words_, operation);
+            else if (erosion && !border_foreground)
+                std::fill(dst, dst + words_, EmptyWord);
+        }
+
+        clearPadding(dst);
+    }
+
+    return;
+}
@@ -0,0 +1,227 @@
+﻿/*
+    Реализация анализа связных областей бинарного изображения.
+*/
+
+#include <algorithm>
+
+#include <ComponentAnalysis.h>
+#include <ParallelStrips.h>
+#include <UnionFind.h>
+
+using namespace cv;
+using namespace std;
+
+const uchar ForeGround = 255;
+
+ComponentAnalysis::ComponentAnalysis()
+:strips_(), parents_(), table_(), components_(), adjacency_(), marked_()
+{
+}
+
+void ComponentAnalysis::apply(const Mat& image)
+{
+    CV_Assert(image.type() == CV_8UC1);
+
+    marked_.create(image.size(), CV_32S);
+
+    const int strips_number = getStripsNumber(image.rows);
+    strips_.resize(strips_number);
+    for (int i = 0; i < strips_number; ++i)
+    {
+        strips_[i].y_begin = image.rows * i / strips_number;
+        strips_[i].y_end = image.rows * (i + 1) / strips_number;
+    }
+
+    parallel_for_(Range(0, strips_number), [&](const Range& range)
+    {
+        for (int i = range.start; i < range.end; ++i)
+            markStrip(image, strips_[i]);
+    }, strips_number);
+
+    // Родитель в полосе всегда меньше потомка, после смещения меток
+    // это свойство сохраняется и для общей таблицы.
+    parents_.clear();
+    vector<Component> stats;
+    adjacency_.clear();
+    for (Strip& strip : strips_)
+    {
+        strip.offset = (int)parents_.size();
+        for (size_t i = 0; i < strip.parents.size(); ++i)
+        {
+            parents_.push_back(strip.parents[i] + strip.offset);
+            stats.push_back(strip.stats[i]);
+        }
+
+        for (const auto& pair : strip.adjacency)
+            adjacency_.emplace_back(pair.first + strip.offset, pair.second + strip.offset);
+    }
+
+    for (int i = 1; i < strips_number; ++i)
+        mergeStrips(image, strips_[i - 1], strips_[i]);
+
+    // Метки создаются в порядке построчного обхода, поэтому корень
+    // каждой области - её первая метка, а начальная точка корня -
+    // начальная точка всей области. При проходе по возрастанию корень
+    // уже найден, и статистика метки сразу переносится в него.
+    table_.resize(parents_.size());
+    components_.clear();
+    for (size_t i = 0; i < parents_.size(); ++i)
+    {
+        const int parent = findRoot((int)i, parents_);
+        if (parent == (int)i)
+        {
+            table_[i] = (int)components_.size();
+            components_.push_back(stats[i]);
+            continue;
+        }
+
+        table_[i] = table_[parent];
+        Component& component = components_[table_[i]];
+        component.area += stats[i].area;
+        component.box = component.box | stats[i].box;
+    }
+
+    for (auto& pair : adjacency_)
+        pair = make_pair(table_[pair.first - 1], table_[pair.second - 1]);
+
+    return;
+}
+
+const vector<Component>& ComponentAnalysis::getComponents() const
+{
+    return components_;
+}
+
+const vector<pair<int, int>>& ComponentAnalysis::getAdjacency() const
+{
+    return adjacency_;
+}
+
+void ComponentAnalysis::paint(const vector<uchar>& values, Mat& image) const
+{
+    CV_Assert((image.size() == marked_.size()) && (image.type() == CV_8UC1));
+    CV_Assert(values.size() == components_.size());
+
+    parallel_for_(Range(0, (int)strips_.size()), [&](const Range& range)
+    {
+        for (int i = range.start; i < range.end; ++i)
+        {
+            const Strip& strip = strips_[i];
+            for (int y = strip.y_begin; y < strip.y_end; ++y)
+            {
+                const int* src = marked_.ptr<int>(y);
+                uchar* dst = image.ptr(y);
+                for (int x = 0; x < image.cols; ++x)
+                    dst[x] = values[table_[src[x] + strip.offset - 1]];
+            }
+        }
+    }, (double)strips_.size());
+
+    return;
+}
+
+void ComponentAnalysis::markStrip(const Mat& image, Strip& strip)
+{
+    strip.parents.clear();
+    strip.stats.clear();
+    strip.adjacency.clear();
+
+    for (int y = strip.y_begin; y < strip.y_end; ++y)
+    {
+        const uchar* src = image.ptr(y);
+        int* ptr = marked_.ptr<int>(y);
+        const int* top = (y > strip.y_begin) ? marked_.ptr<int>(y - 1) : nullptr;
+
+        int x = 0;
+        while (x < image.cols)
+        {
+            // Серия точек одного цвета в строке связна, поэтому объединять
+            // метки нужно только с областями над этой серией.
+            const bool foreground = (src[x] == ForeGround);
+            const int begin = x;
+            while ((x < image.cols) && ((src[x] == ForeGround) == foreground))
+                ++x;
+
+            int label = 0;
+            strip.opposite.clear();
+            if (top != nullptr)
+            {
+                int previous = 0;
+                for (int i = begin; i < x; ++i)
+                {
+                    const int current = top[i];
+                    if (current == previous)
+                        continue;
+
+                    previous = current;
+                    if (strip.stats[current - 1].foreground != foreground)
+                        strip.opposite.push_back(current);
+                    else if (label == 0)
+                        label = current;
+                    else if (label != current)
+                        label = mergeSets(label - 1, current - 1, strip.parents) + 1;
+                }
+            }
+
+            if (label == 0)
+            {
+                // Найдена новая область.
+                strip.parents.push_back((int)strip.parents.size());
+                strip.stats.push_back({ foreground, 0, Rect(begin, y, x - begin, 1), Point(begin, y) });
+                label = (int)strip.parents.size();
+            }
+
+            Component& stats = strip.stats[label - 1];
+            stats.area += x - begin;
+            stats.box = stats.box | Rect(begin, y, x - begin, 1);
+
+            // Соседние серии в строке всегда разного цвета.
+            if (begin > 0)
+                strip.opposite.push_back(ptr[begin - 1]);
+
+            for (int current : strip.opposite)
+            {
+                if (foreground)
+                    strip.adjacency.emplace_back(label, current);
+                else
+                    strip.adjacency.emplace_back(current, label);
+            }
+
+            for (int i = begin; i < x; ++i)
+                ptr[i] = label;
+        }
+    }
+
+    return;
+}
+
+void ComponentAnalysis::mergeStrips(const Mat& image, const Strip& top, const Strip& bottom)
+{
+    const uchar* top_src = image.ptr(top.y_end - 1);
+    const uchar* bottom_src = image.ptr(bottom.y_begin);
+    const int* top_row = marked_.ptr<int>(top.y_end - 1);
+    const int* bottom_row = marked_.ptr<int>(bottom.y_begin);
+
+    int previous_top = 0, previous_bottom = 0;
+    for (int x = 0; x < image.cols; ++x)
+    {
+        // Внутри серии пары меток повторяются.
+        if ((top_row[x] == previous_top) && (bottom_row[x] == previous_bottom))
+            continue;
+
+        previous_top = top_row[x];
+        previous_bottom = bottom_row[x];
+
+        const int top_label = top_row[x] + top.offset;
+        const int bottom_label = bottom_row[x] + bottom.offset;
+        const bool top_foreground = (top_src[x] == ForeGround);
+        if (top_foreground == (bottom_src[x] == ForeGround))
+            mergeSets(top_label - 1, bottom_label - 1, parents_);
+        else if (top_foreground)
+            adjacency_.emplace_back(top_label, bottom_label);
+        else
+            adjacency_.emplace_back(bottom_label, top_label);
+    }
+
+    return;
+}
@@ -2,11 +2,15 @@
     Реализация алгоритма поиска контуров на бинарном изображении.
 */
 
+#include <algorithm>
 #include <assert.h>
-#include <optional>
+#include <cstring>
+#include <tuple>
 
 #include <Contour.h>
 #include <Debug.h>
+#include <ParallelStrips.h>
+#include <UnionFind.h>
 
 using namespace std;
 using namespace cv;
@@ -14,227 +18,663 @@ using namespace cv;
 const uchar Background = 0;
 const uchar ForeGround = 255;
 
-// Кодирует направление между двумя точками.
-static int codeDirection(const Point2i& first, const Point2i& second)
+// Смещения к соседним точкам для кодов направлений. Коды возрастают
+// по часовой стрелке, начиная с направления вверх.
+static const Point2i Directions[8] = { {  0, -1 }, {  1, -1 }, {  1,  0 }, {  1,  1 },
+                                       {  0,  1 }, { -1,  1 }, { -1,  0 }, { -1, -1 } };
+
+// Коды направлений на соседей справа и слева.
+const int EastDirection = 2;
+const int WestDirection = 6;
+
+// Функция декодирует направление между двумя точками.
+static inline Point2i decodeDirection(const Point2i& point, const int code)
 {
-    const int dx = second.x - first.x;
-    const int dy = second.y - first.y;
-    if ((abs(dx) > 1) || (abs(dy) > 1))
-        return -1;
+    return point + Directions[code];
+}
 
-    if (dx > 0)
-    {
-        if (dy > 0)
-            return 3;
-        else if (dy < 0)
-            return 1;
-        else
-            return 2;
-    }
-    else if (dx < 0)
+// Количество 3-битных кодов в одном слове буфера.
+const size_t CodesPerWord = 21;
+
+Contour::Iterator::Iterator(const ContourStore* store, const Point2i& point, size_t code, size_t end_code, size_t index)
+:store_(store), point_(point), code_(code), end_code_(end_code), index_(index)
+{
+}
+
+Contour::Iterator& Contour::Iterator::operator++()
+{
+    // За последней точкой контура кодов нет.
+    if (code_ < end_code_)
     {
-        if (dy > 0)
-            return 5;
-        else if (dy < 0)
-            return 7;
-        else
-            return 6;
+        point_ = decodeDirection(point_, store_->getCode(code_));
+        ++code_;
     }
-    else
+
+    ++index_;
+    return *this;
+}
+
+Contour::Iterator Contour::Iterator::operator++(int)
+{
+    Iterator previous = *this;
+    ++(*this);
+    return previous;
+}
+
+Contour::Contour(const ContourStore* store, const Point2i& start, size_t offset, size_t length)
+:store_(store), start_(start), offset_(offset), length_(length)
+{
+}
+
+size_t Contour::size() const
+{
+    return length_ + 1;
+}
+
+Point2i Contour::getStart() const
+{
+    return start_;
+}
+
+int Contour::getCode(size_t i) const
+{
+    return store_->getCode(offset_ + i);
+}
+
+Contour::Iterator Contour::begin() const
+{
+    return Iterator(store_, start_, offset_, offset_ + length_, 0);
+}
+
+Contour::Iterator Contour::end() const
+{
+    // Итераторы сравниваются по номеру точки.
+    return Iterator(store_, start_, offset_ + length_, offset_ + length_, size());
+}
+
+void Contour::getContour(vector<Point2i>& points) const
+{
+    points.assign(begin(), end());
+    return;
+}
+
+ContourDescriptor Contour::getDescriptor() const
+{
+    // Количество прямых и диагональных шагов.
+    size_t straight = 0;
+    size_t diagonal = 0;
+    // Удвоенная ориентированная площадь по формуле площади Гаусса.
+    int64 doubled_area = 0;
+    Point2i point = start_;
+    Point2i top_left = start_;
+    Point2i bottom_right = start_;
+    for (size_t i = 0; i < length_; ++i)
     {
-        if (dy > 0)
-            return 4;
-        else if (dy < 0)
-            return 0;
+        const int code = getCode(i);
+        const Point2i& step = Directions[code];
+        if (code & 1)
+            ++diagonal;
         else
-            return -1;
+            ++straight;
+
+        doubled_area += (int64)point.x * step.y - (int64)point.y * step.x;
+        point += step;
+        top_left.x = std::min(top_left.x, point.x);
+        top_left.y = std::min(top_left.y, point.y);
+        bottom_right.x = std::max(bottom_right.x, point.x);
+        bottom_right.y = std::max(bottom_right.y, point.y);
     }
+
+    ContourDescriptor descriptor;
+    descriptor.perimeter = straight + sqrt(2.0) * diagonal;
+    descriptor.area = std::abs((double)doubled_area) / 2;
+    descriptor.compactness = (descriptor.perimeter > 0) ?
+        4 * CV_PI * descriptor.area / (descriptor.perimeter * descriptor.perimeter) : 0.0;
+    descriptor.box = Rect(top_left, bottom_right + Point2i(1, 1));
+    return descriptor;
 }
 
-// Функция декодирует направление между двумя точками.
-static Point2i decodeDirection(const Point2i& point, const int code)
+void Contour::printContour(Mat& image, uchar label) const
 {
-    if ((code > 7) || (code < 0))
+    if (image.empty())
         throw;
 
-    Point2i result(0, 0);
-
-    // Определяем координату x.
-    switch (code)
+    for (const Point2i& point : *this)
     {
-        case 0:
-        case 4:
-            result.x = point.x;
-            break;
-        case 1:
-        case 2:
-        case 3:
-            result.x = point.x + 1;
-            break;
-        case 5:
-        case 6:
-        case 7:
-            result.x = point.x - 1;
-            break;
-        default:
-            throw;
+        assert((point.x >= 0) && (point.x < image.cols) &&
+               (point.y >= 0) && (point.y < image.rows));
+
+        // Отмечаем точку контура на изображении.
+        image.ptr(point.y)[point.x] = label;
     }
 
-    // Определяем координату y.
-    switch (code)
+    return;
+}
+
+ContourStore::ContourStore()
+:records_(), codes_(), codes_number_(0), stripes_(), runs_(), rows_(), parents_(), frame_(),
+excluded_(nullptr), image_(), previous_(nullptr), previous_order_(), changed_(), tile_size_(0)
+{
+}
+
+void ContourStore::clear()
+{
+    records_.clear();
+    codes_.clear();
+    codes_number_ = 0;
+    return;
+}
+
+size_t ContourStore::size() const
+{
+    return records_.size();
+}
+
+bool ContourStore::empty() const
+{
+    return records_.empty();
+}
+
+Contour ContourStore::operator[](size_t i) const
+{
+    const Record& record = records_[i];
+    return Contour(this, record.start, record.offset, record.length);
+}
+
+void ContourStore::extract(const Mat& image, const vector<Rect>& excluded, size_t min_size)
+{
+    previous_ = nullptr;
+    findBorders(image, excluded, min_size);
+    return;
+}
+
+void ContourStore::extract(const Mat& image, const vector<Rect>& excluded, size_t min_size,
+                           const ContourStore& previous, const Mat& changed, int tile_size)
+{
+    CV_Assert((&previous != this) && (tile_size > 0) && (changed.type() == CV_8UC1));
+
+    previous_ = &previous;
+    changed_ = changed;
+    tile_size_ = tile_size;
+
+    // Контуры previous упорядочиваются по начальным точкам для двоичного поиска.
+    previous_order_.resize(previous.size());
+    for (size_t i = 0; i < previous_order_.size(); ++i)
+        previous_order_[i] = (int)i;
+
+    const vector<Record>& records = previous.records_;
+    sort(previous_order_.begin(), previous_order_.end(), [&](int first, int second)
     {
-        case 0:
-        case 1:
-        case 7:
-            result.y = point.y - 1;
-            break;
-        case 2:
-        case 6:
-            result.y = point.y;
-            break;
-        case 3:
-        case 4:
-        case 5:
-            result.y = point.y + 1;
-            break;
-        default:
-            throw;
-    }
+        const Record& a = records[first];
+        const Record& b = records[second];
+        return make_tuple(a.start.y, a.start.x, a.hole) < make_tuple(b.start.y, b.start.x, b.hole);
+    });
 
-    return result;
+    findBorders(image, excluded, min_size);
+
+    previous_ = nullptr;
+    changed_.release();
+    return;
 }
 
-Contour::Contour(const Mat& image, const Point2i& point) : start_(point), chain_code_()
+int ContourStore::getSource(size_t i) const
 {
-    Point2i current_contour = point;
-    Point2i current_bg = {point.x - 1, point.y};
+    return records_[i].source;
+}
 
-    while (true)
+void ContourStore::findBorders(const Mat& image, const vector<Rect>& excluded, size_t min_size)
+{
+    CV_Assert(image.type() == CV_8UC1);
+
+    clear();
+    image_ = image;
+    excluded_ = &excluded;
+
+    const int stripes_number = getStripsNumber(image.rows);
+    stripes_.resize(stripes_number);
+    for (int i = 0; i < stripes_number; ++i)
     {
-        int direction = codeDirection(current_contour, current_bg);
-        int next_chain = -1;
+        stripes_[i].y_begin = image.rows * i / stripes_number;
+        stripes_[i].y_end = image.rows * (i + 1) / stripes_number;
+    }
 
-        // Просматриваем 8ку соседей по часовой стрелке, начиная с точки фона.
-        for (int i = 1; i <= 7; ++i)
+    parallel_for_(Range(0, stripes_number), [&](const Range& range)
+    {
+        for (int i = range.start; i < range.end; ++i)
+            buildRuns(stripes_[i]);
+    }, stripes_number);
+
+    runs_.clear();
+    rows_.resize(image.rows + 1);
+    rows_[0] = 0;
+    for (const Stripe& stripe : stripes_)
+    {
+        runs_.insert(runs_.end(), stripe.runs.begin(), stripe.runs.end());
+        for (int y = stripe.y_begin; y < stripe.y_end; ++y)
+            rows_[y + 1] = rows_[y] + stripe.counts[y - stripe.y_begin];
+    }
+
+    // Узлы полосы занимают непрерывные диапазоны номеров, поэтому
+    // полосы объединяют свои узлы независимо.
+    const int nodes_number = 2 * (int)runs_.size() + image.rows;
+    parents_.resize(nodes_number);
+    frame_.resize(runs_.size() + image.rows);
+    parallel_for_(Range(0, stripes_number), [&](const Range& range)
+    {
+        for (int i = range.start; i < range.end; ++i)
         {
-            int new_direction = (direction + i) % 8;
-            Point2i next_point = decodeDirection(current_contour, new_direction);
+            const Stripe& stripe = stripes_[i];
+            for (int j = rows_[stripe.y_begin]; j < rows_[stripe.y_end]; ++j)
+                parents_[j] = j;
 
-            if (next_point.x < 0 || next_point.x >= image.cols || next_point.y < 0 || next_point.y >= image.rows)
+            for (int y = stripe.y_begin; y < stripe.y_end; ++y)
             {
-                current_bg = next_point;
+                for (int k = 0; k <= rows_[y + 1] - rows_[y]; ++k)
+                {
+                    const int node = getGapNode(y, k);
+                    const Run gap = getGap(y, k);
+                    parents_[node] = node;
+                    frame_[node - runs_.size()] = (gap.begin < gap.end) &&
+                        ((gap.begin == 0) || (gap.end == image_.cols) || (y == 0) || (y == image_.rows - 1));
+                }
+
+                if (y > stripe.y_begin)
+                    linkRows(y);
+            }
+        }
+    }, stripes_number);
+
+    for (int i = 1; i < stripes_number; ++i)
+        linkRows(stripes_[i].y_begin);
+
+    // Родитель всегда меньше потомка, поэтому при проходе по возрастанию
+    // родитель уже указывает на корень. Связь с краем изображения
+    // собирается в корне области фона.
+    for (int i = 0; i < nodes_number; ++i)
+    {
+        parents_[i] = parents_[parents_[i]];
+        if (i >= (int)runs_.size())
+            frame_[parents_[i] - runs_.size()] |= frame_[i - runs_.size()];
+    }
+
+    parallel_for_(Range(0, stripes_number), [&](const Range& range)
+    {
+        for (int i = range.start; i < range.end; ++i)
+            traceStripe(stripes_[i]);
+    }, stripes_number);
+
+    // Границы полос уже упорядочены построчно.
+    for (const Stripe& stripe : stripes_)
+    {
+        for (const Record& record : stripe.records)
+        {
+            if (record.length + 1 < min_size)
                 continue;
+
+            Record copy = record;
+            copy.offset = codes_number_;
+            records_.push_back(copy);
+            if (record.source >= 0)
+            {
+                for (size_t i = 0; i < record.length; ++i)
+                    pushCode(previous_->getCode(record.offset + i));
+            }
+            else
+            {
+                for (size_t i = 0; i < record.length; ++i)
+                    pushCode(stripe.codes[record.offset + i]);
             }
+        }
+    }
 
-            uchar value = image.ptr(next_point.y)[next_point.x];
-            if (value == Background)
+    image_.release();
+    excluded_ = nullptr;
+    return;
+}
+
+void ContourStore::buildRuns(Stripe& stripe) const
+{
+    stripe.runs.clear();
+    stripe.counts.clear();
+    for (int y = stripe.y_begin; y < stripe.y_end; ++y)
+    {
+        const uchar* ptr = image_.ptr(y);
+        const size_t row_begin = stripe.runs.size();
+        int x = 0;
+        while (x < image_.cols)
+        {
+            if (ptr[x] != ForeGround)
             {
-                current_bg = next_point;
+                ++x;
                 continue;
             }
 
-            next_chain = new_direction;
-            if (chain_code_.size() > 0 && current_contour == start_ && next_chain == chain_code_[0])
-                return;
+            const int begin = x;
+            while ((x < image_.cols) && (ptr[x] == ForeGround))
+                ++x;
 
-            current_contour = next_point;
-            break;
+            addRun(y, begin, x, stripe.runs);
         }
 
-        // Контур из одной точки.
-        if (next_chain == -1)
-            break;
+        stripe.counts.push_back((int)(stripe.runs.size() - row_begin));
+    }
+
+    return;
+}
+
+void ContourStore::addRun(int y, int begin, int end, vector<Run>& runs) const
+{
+    // Серия разрезается исключёнными прямоугольниками, пересекающими строку.
+    int x = begin;
+    while (x < end)
+    {
+        bool excluded = false;
+        int free_end = end;
+        for (const Rect& box : *excluded_)
+        {
+            if ((y < box.y) || (y >= box.y + box.height))
+                continue;
+
+            if ((box.x <= x) && (x < box.x + box.width))
+            {
+                x = box.x + box.width;
+                excluded = true;
+            }
+            else if (box.x > x)
+            {
+                free_end = std::min(free_end, box.x);
+            }
+        }
+
+        if (excluded)
+            continue;
 
-        chain_code_.push_back(next_chain);
+        runs.push_back({ x, free_end });
+        x = free_end;
     }
 
     return;
 }
 
-size_t Contour::size() const
+Run ContourStore::getGap(int y, int k) const
+{
+    const int first = rows_[y];
+    const int last = rows_[y + 1];
+    return { (k == 0) ? 0 : runs_[first + k - 1].end,
+             (first + k == last) ? image_.cols : runs_[first + k].begin };
+}
+
+int ContourStore::getGapNode(int y, int k) const
 {
-    return chain_code_.size() + 1;
+    return (int)runs_.size() + rows_[y] + y + k;
 }
 
-vector<Point2i> Contour::getContour() const
+void ContourStore::linkRows(int y)
 {
-    vector<Point2i> points(size());
-    points[0] = start_;
-    for (size_t i = 0; i < size() - 1; ++i)
+    // Серии объектов связаны через 8 соседей.
+    int top = rows_[y - 1];
+    int bottom = rows_[y];
+    while ((top < rows_[y]) && (bottom < rows_[y + 1]))
     {
-        points[i + 1] = decodeDirection(points[i], chain_code_[i]);
+        if ((runs_[top].begin <= runs_[bottom].end) && (runs_[bottom].begin <= runs_[top].end))
+            mergeSets(top, bottom, parents_);
+
+        if (runs_[top].end < runs_[bottom].end)
+            ++top;
+        else
+            ++bottom;
     }
 
-    return points;
+    // Промежутки фона связаны через 4 соседей.
+    top = 0;
+    bottom = 0;
+    while ((top <= rows_[y] - rows_[y - 1]) && (bottom <= rows_[y + 1] - rows_[y]))
+    {
+        const Run top_gap = getGap(y - 1, top);
+        const Run bottom_gap = getGap(y, bottom);
+        if (std::max(top_gap.begin, bottom_gap.begin) < std::min(top_gap.end, bottom_gap.end))
+            mergeSets(getGapNode(y - 1, top), getGapNode(y, bottom), parents_);
+
+        if (top_gap.end < bottom_gap.end)
+            ++top;
+        else
+            ++bottom;
+    }
+
+    return;
 }
 
-void Contour::printContour(Mat& image, uchar label) const
+void ContourStore::traceStripe(Stripe& stripe) const
 {
-    if (image.empty())
-        throw;
+    stripe.records.clear();
+    stripe.codes.clear();
+
+    // Построчный обход по алгоритму Suzuki начинает каждую границу в первой
+    // встреченной точке: внешнюю границу - в первой точке объекта, границу
+    // дырки - слева от первой точки дырки. Поэтому граница принадлежит полосе,
+    // в которой лежит корень её области, и прослеживается ровно один раз.
+    // Области фона, связанные с краем изображения, дырками не являются.
+    for (int y = stripe.y_begin; y < stripe.y_end; ++y)
+    {
+        for (int i = rows_[y]; i < rows_[y + 1]; ++i)
+        {
+            if (parents_[i] == i)
+                traceBorder(Point2i(runs_[i].begin, y), WestDirection, stripe);
+
+            const int k = i - rows_[y] + 1;
+            const int node = getGapNode(y, k);
+            const Run gap = getGap(y, k);
+            if ((gap.begin < gap.end) && (parents_[node] == node) && !frame_[node - runs_.size()])
+                traceBorder(Point2i(runs_[i].end - 1, y), EastDirection, stripe);
+        }
+    }
 
-    Point2i point = start_;
+    return;
+}
 
-    uchar* image_ptr = image.ptr(point.y);
-    image_ptr[point.x] = label;
+bool ContourStore::isObject(const Point2i& point) const
+{
+    if ((point.x < 0) || (point.x >= image_.cols) || (point.y < 0) || (point.y >= image_.rows))
+        return false;
+
+    if (image_.ptr(point.y)[point.x] != ForeGround)
+        return false;
 
-    Point2i next_point(-1, -1);
-    for (vector<int>::const_iterator i = chain_code_.begin(); i != chain_code_.end(); ++i)
+    for (const Rect& box : *excluded_)
     {
-        next_point = decodeDirection(point, *i);
-        assert((next_point.x >= 0) && (next_point.x < image.cols) &&
-               (next_point.y >= 0) && (next_point.y < image.rows));
+        if (box.contains(point))
+            return false;
+    }
 
-        // Отмечаем точку контура на изображении.
-        uchar* image_ptr = image.ptr(next_point.y);
-        image_ptr[next_point.x] = label;
+    return true;
+}
+
+int ContourStore::findPrevious(const Point2i& start, bool hole) const
+{
+    if (previous_ == nullptr)
+        return -1;
+
+    const vector<Record>& records = previous_->records_;
+    const auto found = lower_bound(previous_order_.begin(), previous_order_.end(), make_tuple(start.y, start.x, hole),
+        [&](int index, const tuple<int, int, bool>& key)
+        {
+            const Record& record = records[index];
+            return make_tuple(record.start.y, record.start.x, record.hole) < key;
+        });
+
+    if (found == previous_order_.end())
+        return -1;
+
+    const Record& record = records[*found];
+    if ((record.start != start) || (record.hole != hole))
+        return -1;
 
-        point = next_point;
+    // Граница зависит только от точек своего прямоугольника и соседних с ним.
+    const Rect area = Rect(record.box.x - 1, record.box.y - 1, record.box.width + 2, record.box.height + 2) &
+                      Rect(0, 0, image_.cols, image_.rows);
+    for (int y = area.y / tile_size_; y <= (area.y + area.height - 1) / tile_size_; ++y)
+    {
+        const uchar* ptr = changed_.ptr(y);
+        for (int x = area.x / tile_size_; x <= (area.x + area.width - 1) / tile_size_; ++x)
+        {
+            if (ptr[x] != 0)
+                return -1;
+        }
+    }
+
+    return *found;
+}
+
+void ContourStore::traceBorder(const Point2i& start, int direction, Stripe& stripe) const
+{
+    const bool hole = (direction == EastDirection);
+    const int source = findPrevious(start, hole);
+    if (source >= 0)
+    {
+        Record record = previous_->records_[source];
+        record.source = source;
+        stripe.records.push_back(record);
+        return;
+    }
+
+    const size_t offset = stripe.codes.size();
+
+    // Предыдущая точка границы - первая точка объекта при обходе
+    // соседей против часовой стрелки, начиная с точки фона.
+    int previous = -1;
+    for (int i = 0; i < 8; ++i)
+    {
+        const int code = (direction - i) & 7;
+        if (isObject(decodeDirection(start, code)))
+        {
+            previous = code;
+            break;
+        }
+    }
+
+    // Контур из одной точки не сохраняется.
+    if (previous == -1)
+        return;
+
+    const Point2i last = decodeDirection(start, previous);
+    Point2i current = start;
+    Point2i top_left = start;
+    Point2i bottom_right = start;
+    while (true)
+    {
+        // Следующая точка - первая точка объекта при обходе соседей
+        // по часовой стрелке, начиная после предыдущей точки.
+        int next = previous;
+        for (int i = 1; i <= 8; ++i)
+        {
+            const int code = (previous + i) & 7;
+            if (isObject(decodeDirection(current, code)))
+            {
+                next = code;
+                break;
+            }
+        }
+
+        stripe.codes.push_back((uchar)next);
+
+        const Point2i next_point = decodeDirection(current, next);
+        if ((next_point == start) && (current == last))
+            break;
+
+        previous = (next + 4) & 7;
+        current = next_point;
+        top_left.x = std::min(top_left.x, current.x);
+        top_left.y = std::min(top_left.y, current.y);
+        bottom_right.x = std::max(bottom_right.x, current.x);
+        bottom_right.y = std::max(bottom_right.y, current.y);
     }
 
+    stripe.records.push_back({ start, offset, stripe.codes.size() - offset,
+                               Rect(top_left, bottom_right + Point2i(1, 1)), hole, -1 });
     return;
 }
 
-vector<Contour> extractContours(InputArray BinImage, InputArray Mask)
+int ContourStore::getCode(size_t index) const
 {
-    Mat image(BinImage.getMat());
-    Mat mask(Mask.getMat());
+    return (codes_[index / CodesPerWord] >> (3 * (index % CodesPerWord))) & 7;
+}
 
-    // С помощью бинарной морфологии получаем границы объектов (обводим сверху).
-    Matx <uchar, 3, 3> kernel_erode = { 0, 1, 0,
-                                        1, 1, 1,
-                                        0, 1, 0 };
+void ContourStore::pushCode(int code)
+{
+    const size_t word = codes_number_ / CodesPerWord;
+    const int shift = 3 * (codes_number_ % CodesPerWord);
+    if (word == codes_.size())
+        codes_.push_back(0);
 
-    Mat contours_image(image.rows, image.cols, CV_8U);
-    erode(image, contours_image, kernel_erode, Point(-1,-1), 1, BORDER_CONSTANT, Background);
-    contours_image = image - contours_image;
-    imageWrite("Erode", contours_image);
+    codes_[word] |= (uint64)code << shift;
+    ++codes_number_;
+    return;
+}
 
-    bitwise_and(contours_image, mask, contours_image);
+void extractContours(InputArray BinImage, const vector<Rect>& excluded, ContourStore& contours)
+{
+    // Контуры короче 4 точек не используются.
+    contours.extract(BinImage.getMat(), excluded, 4);
+    return;
+}
+
+void extractContours(InputArray BinImage, const vector<Rect>& excluded, const ContourStore& previous,
+                     const Mat& changed, int tile_size, ContourStore& contours)
+{
+    contours.extract(BinImage.getMat(), excluded, 4, previous, changed, tile_size);
+    return;
+}
+
+void findChangedTiles(const Mat& previous, const vector<Rect>& previous_excluded,
+                      const Mat& image, const vector<Rect>& excluded,
+                      int tile_size, Mat& changed)
+{
+    CV_Assert((previous.size() == image.size()) && (previous.type() == CV_8UC1) &&
+              (image.type() == CV_8UC1) && (tile_size > 0));
 
-    // Записываем все контуры, найденные на изображении.
-    vector<Contour> contours;
-    for (int y = 0; y < contours_image.rows; ++y)
+    changed.create((image.rows + tile_size - 1) / tile_size, (image.cols + tile_size - 1) / tile_size, CV_8UC1);
+    changed.setTo(0);
+    for (int y = 0; y < image.rows; ++y)
     {
-        uchar* ptr = contours_image.ptr(y);
-        for (int x = 0; x < contours_image.cols; ++x)
+        const uchar* previous_ptr = previous.ptr(y);
+        const uchar* ptr = image.ptr(y);
+        uchar* tiles = changed.ptr(y / tile_size);
+        for (int x = 0; x < image.cols; x += tile_size)
         {
-            if (ptr[x] != ForeGround)
+            // Блок, уже отмеченный в предыдущих строках, не сравнивается.
+            if (tiles[x / tile_size] != 0)
                 continue;
 
-            Point2i point(x, y);
-            Contour current(contours_image, point);
-            // Удаляем контур с изображения.
-            current.printContour(contours_image, Background);
-            if (current.size() >= 4)
-                contours.push_back(current);
+            const int width = std::min(tile_size, image.cols - x);
+            if (memcmp(previous_ptr + x, ptr + x, width) != 0)
+                tiles[x / tile_size] = 1;
         }
     }
 
-    return contours;
+    // Прямоугольник, исключённый только на одном кадре, меняет точки фона.
+    auto markBoxes = [&](const vector<Rect>& boxes, const vector<Rect>& other)
+    {
+        for (const Rect& box : boxes)
+        {
+            if (find(other.begin(), other.end(), box) != other.end())
+                continue;
+
+            const Rect area = box & Rect(0, 0, image.cols, image.rows);
+            if (area.empty())
+                continue;
+
+            changed(Rect(area.x / tile_size, area.y / tile_size,
+                         (area.x + area.width - 1) / tile_size - area.x / tile_size + 1,
+                         (area.y + area.height - 1) / tile_size - area.y / tile_size + 1)).setTo(1);
+        }
+    };
+
+    markBoxes(previous_excluded, excluded);
+    markBoxes(excluded, previous_excluded);
+    return;
 }
 
-void printContours(Mat& image, const vector<Contour>& contours)
+void printContours(Mat& image, const ContourStore& contours)
 {
     image.setTo(0);
     for (size_t i = 0; i < contours.size(); ++i)
@@ -250,23 +690,17 @@ void printContours(Mat& image, const vector<Contour>& contours)
     return;
 }
 
-// TODO: использовать функцию qsort.
-void sortContours(vector<Contour>& contours)
+void selectContours(const vector<double>& scores, size_t count, vector<int>& indexes)
 {
-    size_t size = contours.size();
-    if (size == 0)
-        return;
+    if ((count == 0) || (count > indexes.size()))
+        count = indexes.size();
 
-    for (size_t i = size - 1; i > 1; --i)
+    // При равных оценках первым идёт контур, найденный раньше.
+    partial_sort(indexes.begin(), indexes.begin() + count, indexes.end(), [&](int first, int second)
     {
-        for (size_t j = 0; j < i; ++j)
-        {
-            const size_t current_size = contours[j].size();
-            const size_t next_size = contours[j + 1].size();
-            if (current_size < next_size)
-                swap(contours[j], contours[j + 1]);
-        }
-    }
+        return (scores[first] > scores[second]) || ((scores[first] == scores[second]) && (first < second));
+    });
 
+    indexes.resize(count);
     return;
 }
@@ -0,0 +1,130 @@
+﻿/*
+    Реализация сглаживания контура низкочастотной фильтрацией.
+*/
+
+#include <algorithm>
+
+#include <ContourSmoother.h>
+
+using namespace cv;
+using namespace std;
+
+ContourSmoother::ContourSmoother()
+:signal_(), buffer_(), spatial_threshold_(0)
+{
+}
+
+void ContourSmoother::setSpatialThreshold(size_t spatial_threshold)
+{
+    spatial_threshold_ = spatial_threshold;
+    return;
+}
+
+void ContourSmoother::apply(const vector<Point2i>& contour, int harmonics, vector<Point2f>& smoothed)
+{
+    CV_Assert(!contour.empty());
+
+    harmonics = std::max(harmonics, 0);
+    if ((spatial_threshold_ > 0) && (contour.size() >= spatial_threshold_))
+        smoothSpatial(contour, harmonics, smoothed);
+    else
+        smoothFourier(contour, harmonics, smoothed);
+
+    return;
+}
+
+// Периодическая линейная интерполяция сигнала src из src_length точек
+// в dst_length точек: точка i берётся в точке i * src_length / dst_length.
+static void resampleSignal(const Point2f* src, int src_length, Point2f* dst, int dst_length)
+{
+    const double step = (double)src_length / dst_length;
+    for (int i = 0; i < dst_length; ++i)
+    {
+        const double position = i * step;
+        const int index = (int)position;
+        const int next = (index + 1 == src_length) ? 0 : index + 1;
+        const float weight = (float)(position - index);
+        dst[i] = src[index] * (1 - weight) + src[next] * weight;
+    }
+
+    return;
+}
+
+void ContourSmoother::smoothFourier(const vector<Point2i>& contour, int harmonics, vector<Point2f>& smoothed)
+{
+    const int length = (int)contour.size();
+    const int size = getOptimalDFTSize(length);
+    if (signal_.cols < size)
+        signal_.create(1, size, CV_32FC2);
+    Mat signal_mat = signal_.colRange(0, size);
+    Point2f* signal = signal_mat.ptr<Point2f>();
+
+    smoothed.resize(length);
+    for (int i = 0; i < length; ++i)
+        smoothed[i] = Point2f(contour[i]);
+    if (size != length)
+        resampleSignal(smoothed.data(), length, signal, size);
+    else
+        std::copy(smoothed.begin(), smoothed.end(), signal);
+
+    // Гармоники с номерами больше harmonics занимают середину спектра.
+    dft(signal_mat, signal_mat);
+    for (int i = harmonics + 1; i < size - harmonics; ++i)
+        signal[i] = Point2f(0, 0);
+
+    dft(signal_mat, signal_mat, DFT_INVERSE + DFT_SCALE);
+
+    if (size != length)
+        resampleSignal(signal, size, smoothed.data(), length);
+    else
+        std::copy(signal, signal + length, smoothed.begin());
+
+    return;
+}
+
+// Скользящее среднее по 2 * radius + 1 точкам замкнутого контура.
+static void averageContour(const vector<Point2f>& src, int radius, vector<Point2f>& dst)
+{
+    const int length = (int)src.size();
+    dst.resize(length);
+    const int window = 2 * radius + 1;
+    Point2d sum(0, 0);
+    if (window >= length)
+    {
+        for (const Point2f& point : src)
+            sum += Point2d(point);
+
+        std::fill(dst.begin(), dst.end(), Point2f(sum * (1.0 / length)));
+        return;
+    }
+
+    for (int i = -radius; i <= radius; ++i)
+        sum += Point2d(src[(i + length) % length]);
+
+    for (int i = 0; i < length; ++i)
+    {
+        dst[i] = Point2f(sum * (1.0 / window));
+        sum += Point2d(src[(i + radius + 1) % length]) - Point2d(src[(i - radius + length) % length]);
+    }
+
+    return;
+}
+
+void ContourSmoother::smoothSpatial(const vector<Point2i>& contour, int harmonics, vector<Point2f>& smoothed)
+{
+    // Первый ноль частотной характеристики окна шириной length / (3 * harmonics)
+    // приходится на гармонику 3 * harmonics, гармоника harmonics после двух
+    // проходов ослабляется примерно в 1.5 раза, второй проход подавляет
+    // боковые лепестки.
+    const int length = (int)contour.size();
+    const int window = (harmonics > 0) ? length / (3 * harmonics) : length;
+    const int radius = std::max(window / 2, 0);
+
+    smoothed.resize(length);
+    for (int i = 0; i < length; ++i)
+        smoothed[i] = Point2f(contour[i]);
+
+    averageContour(smoothed, radius, buffer_);
+    averageContour(buffer_, radius, smoothed);
+    return;
+}
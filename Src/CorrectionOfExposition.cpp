@@ -9,47 +9,77 @@
 
 using namespace cv;
 
-const uchar Background = 0;
-
-void correctionOfExposition(const Mat& segmentationMask,
-                            const Mat& backgroundImage,
+void correctionOfExposition(const RunMask& segmentationMask,
+                            const Mat& backgroundLuma,
+                            int64 backgroundLumaSum,
                             Mat& currentImage)
 {
-    Mat background_image = backgroundImage.clone();
-    cvtColor(background_image, background_image, COLOR_BGR2YCrCb);
+    // Маска и яркость фона должны соответствовать кадру точка в точку.
+    CV_Assert(backgroundLuma.size() == currentImage.size() && segmentationMask.size() == currentImage.size());
+
     cvtColor(currentImage, currentImage, COLOR_BGR2YCrCb);
 
     // Размер зоны вокруг объектов, зарезервированной под движение.
     // (Ориентировочное расстояние, на которое могли переместиться
     // объекты между двумя кадрами).
     const int reserved_area = 5;
-    // Изображение с отмечеными фоновыми пикселями.
-    Mat markedImage;
 
     // Создраём вокруг объектов область из reserved_area точек,
     // в которой может появиться движение.
-    Matx<uchar, 3, 3> kernel = {
-        0, 1, 0,
-        1, 1, 1,
-        0, 1, 0};
-    dilate(segmentationMask, markedImage, kernel, Point(1, 1), reserved_area);
-
-    // Высчитываем суммарную яркость точек фона.
-    double background_light = 0; // Переменная для хранения суммарной яркости фона.
+    RunMask markedMask(segmentationMask);
+    markedMask.dilateCross(reserved_area);
+
+    // Суммарная яркость фона в промежутках между сериями отмеченных точек
+    // равна сумме яркостей всего фона за вычетом рамки шириной reserved_area
+    // и отмеченных серий, поэтому фон читается только в этих точках.
+    const int rows = currentImage.rows, cols = currentImage.cols;
+    const int x_end = cols - reserved_area;
+    int64 excluded_light = 0;
+    for (int y = 0; y < rows; ++y)
+    {
+        const uchar* backgroundLuma_ptr = backgroundLuma.ptr(y);
+        if ((y < reserved_area) || (y >= rows - reserved_area))
+        {
+            for (int x = 0; x < cols; ++x)
+                excluded_light += backgroundLuma_ptr[x];
+            continue;
+        }
+
+        for (int x = 0; x < std::min(reserved_area, cols); ++x)
+            excluded_light += backgroundLuma_ptr[x];
+        for (int x = std::max(x_end, reserved_area); x < cols; ++x)
+            excluded_light += backgroundLuma_ptr[x];
+
+        for (const Run* run = markedMask.rowBegin(y); run != markedMask.rowEnd(y); ++run)
+        {
+            for (int x = std::max(run->begin, reserved_area); x < std::min(run->end, x_end); ++x)
+                excluded_light += backgroundLuma_ptr[x];
+        }
+    }
+    const double background_light = (double)(backgroundLumaSum - excluded_light);
+
+    // Высчитываем суммарную яркость точек текущего кадра, которые лежат
+    // в промежутках между сериями отмеченных точек.
     double current_light = 0; // Переменная для хранения суммарной яркости текущего кадра.
     int counter = 0; // Переменная для хранения количества точек по которым посчитана сумма.
-    for (int y = reserved_area; y < markedImage.rows - reserved_area; ++y)
+    for (int y = reserved_area; y < rows - reserved_area; ++y)
     {
-        const uchar* markedImage_ptr = markedImage.ptr(y);
-        const uchar* background_image_ptr = background_image.ptr(y);
         const uchar* currentImage_ptr = currentImage.ptr(y);
-        for (int x = reserved_area; x < markedImage.cols - reserved_area; ++x)
+        const Run* run = markedMask.rowBegin(y);
+        const Run* run_end = markedMask.rowEnd(y);
+        int x = reserved_area;
+        while (x < x_end)
         {
-            if (markedImage_ptr[x] != Background)
-                continue;
-            background_light += background_image_ptr[3 * x];
-            current_light += currentImage_ptr[3 * x];
-            counter++;
+            const int gap_end = (run != run_end) ? std::min(run->begin, x_end) : x_end;
+            counter += std::max(gap_end - x, 0);
+            for (; x < gap_end; ++x)
+                current_light += currentImage_ptr[3 * x];
+
+            if (run == run_end)
+                break;
+
+            x = std::max(x, run->end);
+            ++run;
         }
     }
 
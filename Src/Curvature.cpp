@@ -1,8 +1,12 @@
 ﻿/*
-Реализация алгоритма поиска контуров на бинарном изображении.
+Реализация вычисления кривизны контура.
 */
 
-#include <Contour.h>
+#include <algorithm>
+#include <cmath>
+#include <opencv2/core/hal/intrin.hpp>
+
+#include <Curvature.h>
 
 using namespace std;
 using namespace cv;
@@ -10,53 +14,145 @@ using namespace cv;
 const uchar Background = 0;
 const uchar ForeGround = 255;
 
-vector<float> getCurvature(const vector<Point2i>& contour, const Size& image_size, const int chord_length)
+// Расстояние от края изображения, ближе которого концы хорд не допускаются.
+const int BorderMargin = 10;
+
+CurvatureEngine::CurvatureEngine()
+:near_border_(), a_(), b_(), c_(), offsets_(), chord_lengths_(), curvatures_()
+{
+}
+
+void CurvatureEngine::apply(const vector<Point2f>& contour, const Size& image_size, int chord_length,
+                            vector<float>& curvature)
 {
-    size_t length = contour.size();
+    // Буфер результата передаётся внутрь без копирования.
+    chord_lengths_.assign(1, chord_length);
+    curvatures_.resize(1);
+    curvatures_[0].swap(curvature);
+    apply(contour, image_size, chord_lengths_, curvatures_);
+    curvatures_[0].swap(curvature);
+    return;
+}
+
+void CurvatureEngine::apply(const vector<Point2f>& contour, const Size& image_size,
+                            const vector<int>& chord_lengths, vector<vector<float>>& curvatures)
+{
+    const int length = (int)contour.size();
     if (length < 4)
         throw;
 
-    vector<float> curvature(length, 0.0);
-    for (size_t i = 0; i < length; ++i)
+    near_border_.resize(length);
+    for (int i = 0; i < length; ++i)
     {
-        // Вычисляем координаты концов хорды.
-        const int first_point = i - chord_length + 2;
-        const int last_point = i + 1;
+        const Point2f& point = contour[i];
+        near_border_[i] = (point.x < BorderMargin) || (point.x >= image_size.width - BorderMargin) ||
+                          (point.y < BorderMargin) || (point.y >= image_size.height - BorderMargin);
+    }
 
-        // Смещаем хорду по контуру.
-        for (int shift = 0; shift <= chord_length - 3; ++shift)
+    // Хорда от точки j до точки j + span проходит над chord_length - 2
+    // точками между ними, поэтому её прямая вычисляется один раз.
+    const size_t scales_number = chord_lengths.size();
+    offsets_.resize(scales_number + 1);
+    offsets_[0] = 0;
+    for (size_t k = 0; k < scales_number; ++k)
+    {
+        const int lines_number = (chord_lengths[k] < 3) ? 0 : std::max(length - chord_lengths[k] + 1, 0);
+        offsets_[k + 1] = offsets_[k] + lines_number;
+    }
+
+    a_.resize(offsets_[scales_number]);
+    b_.resize(offsets_[scales_number]);
+    c_.resize(offsets_[scales_number]);
+    for (size_t k = 0; k < scales_number; ++k)
+    {
+        const int span = chord_lengths[k] - 1;
+        for (size_t j = 0; j < offsets_[k + 1] - offsets_[k]; ++j)
         {
-            int start_index = first_point + shift;
-            if (start_index < 0)
-                start_index = 0;
-            else if (start_index >= (int)length)
-                start_index = (int)length - 1;
-
-            int end_index = last_point + shift;
-            if (end_index >= (int)length)
-                end_index = (int)length - 1;
-
-            // Вычисляем расстояние от точки до хорды.
-            const Point2i chord = contour[end_index] - contour[start_index];
-            const Point2i point_to_chord = contour[i] - contour[start_index];
-
-            // Отбрасываем хорды, которые касаются края изображения
-            if (contour[end_index].x < 10 || contour[end_index].x >= (image_size.width - 10) ||
-                contour[end_index].y < 10 || contour[end_index].y >= (image_size.height - 10) ||
-                contour[start_index].x < 10 || contour[start_index].x >= (image_size.width - 10) ||
-                contour[start_index].y < 10 || contour[start_index].y >= (image_size.height - 10))
+            const size_t line = offsets_[k] + j;
+            const Point2d start = contour[j];
+            const Point2d chord = Point2d(contour[j + span]) - start;
+            const double norm = sqrt(chord.x * chord.x + chord.y * chord.y);
+            if (near_border_[j] || near_border_[j + span] || (norm == 0))
             {
+                a_[line] = b_[line] = c_[line] = 0.0f;
                 continue;
             }
 
-            double distance = abs(point_to_chord.x * chord.y -
-                                  point_to_chord.y * chord.x);
-            distance /= sqrt(chord.x * chord.x + chord.y * chord.y);
-            // Максимальное расстояние и будет кривизной контура в точке.
-            if (distance > curvature[i])
-                curvature[i] = (float)distance;
+            a_[line] = (float)(chord.y / norm);
+            b_[line] = (float)(-chord.x / norm);
+            c_[line] = (float)((start.y * chord.x - start.x * chord.y) / norm);
+        }
+    }
+
+    curvatures.resize(scales_number);
+    for (size_t k = 0; k < scales_number; ++k)
+        curvatures[k].resize(length);
+
+    for (int i = 0; i < length; ++i)
+    {
+        for (size_t k = 0; k < scales_number; ++k)
+        {
+            curvatures[k][i] = getPointCurvature(contour, i, chord_lengths[k], a_.data() + offsets_[k],
+                                                 b_.data() + offsets_[k], c_.data() + offsets_[k]);
         }
     }
 
-    return curvature;
+    return;
+}
+
+float CurvatureEngine::getPointCurvature(const vector<Point2f>& contour, int i, int chord_length,
+                                         const float* a, const float* b, const float* c) const
+{
+    if (chord_length < 3)
+        return 0.0f;
+
+    const int length = (int)contour.size();
+    const int span = chord_length - 1;
+    float distance = 0.0f;
+
+    // У начала и конца контура хорды укорачиваются до крайних точек.
+    if ((i < span - 1) || (i > length - span))
+    {
+        for (int shift = 0; shift <= chord_length - 3; ++shift)
+        {
+            const int start_index = std::min(std::max(i - span + 1 + shift, 0), length - 1);
+            const int end_index = std::min(i + 1 + shift, length - 1);
+            if (near_border_[start_index] || near_border_[end_index])
+                continue;
+
+            const Point2d chord = Point2d(contour[end_index]) - Point2d(contour[start_index]);
+            const Point2d point_to_chord = Point2d(contour[i]) - Point2d(contour[start_index]);
+            const double norm = sqrt(chord.x * chord.x + chord.y * chord.y);
+            if (norm == 0)
+                continue;
+
+            const double chord_distance = abs(point_to_chord.x * chord.y - point_to_chord.y * chord.x) / norm;
+            distance = std::max(distance, (float)chord_distance);
+        }
+
+        return distance;
+    }
+
+    // Расстояния до хорд с началами от i - span + 1 до i - 1.
+    const float x = contour[i].x;
+    const float y = contour[i].y;
+    int j = i - span + 1;
+
+#if CV_SIMD
+    const v_float32 v_x = vx_setall_f32(x);
+    const v_float32 v_y = vx_setall_f32(y);
+    v_float32 v_distance = vx_setall_f32(0.0f);
+    for (; j <= i - v_float32::nlanes; j += v_float32::nlanes)
+    {
+        const v_float32 line = v_muladd(vx_load(a + j), v_x, v_muladd(vx_load(b + j), v_y, vx_load(c + j)));
+        v_distance = v_max(v_distance, v_abs(line));
+    }
+    distance = v_reduce_max(v_distance);
+    vx_cleanup();
+#endif // CV_SIMD
+
+    for (; j < i; ++j)
+        distance = std::max(distance, std::abs(a[j] * x + b[j] * y + c[j]));
+
+    return distance;
 }
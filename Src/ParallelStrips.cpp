@@ -0,0 +1,15 @@
+﻿/*
+    Реализация разбиения изображения на полосы.
+*/
+
+#include <algorithm>
+#include <opencv2/core.hpp>
+
+#include <ParallelStrips.h>
+
+using namespace cv;
+
+int getStripsNumber(int rows)
+{
+    return std::max(1, std::min(getNumThreads(), rows / MinStripHeight));
+}
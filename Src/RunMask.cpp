@@ -0,0 +1,189 @@
+﻿/*
+    Реализация бинарной маски, закодированной сериями точек.
+*/
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include <RunMask.h>
+
+using namespace cv;
+using namespace std;
+
+const uchar BackGround = 0;
+const uchar ForeGround = 255;
+
+// Добавляет серию в конец упорядоченного списка,
+// объединяя её с последней серией при соприкосновении.
+static void appendRun(vector<Run>& runs, int begin, int end)
+{
+    if (begin >= end)
+        return;
+
+    if (!runs.empty() && (begin <= runs.back().end))
+        runs.back().end = std::max(runs.back().end, end);
+    else
+        runs.push_back({ begin, end });
+
+    return;
+}
+
+// Увеличивает каждую серию на left точек слева и right точек справа.
+static void growRuns(const Run* first, const Run* last, int left, int right,
+                     int cols, vector<Run>& dst)
+{
+    for (const Run* run = first; run != last; ++run)
+        appendRun(dst, std::max(0, run->begin - left), std::min(cols, run->end + right));
+
+    return;
+}
+
+// Объединение двух упорядоченных списков серий.
+static void uniteRuns(const vector<Run>& first, const vector<Run>& second, vector<Run>& dst)
+{
+    size_t i = 0, j = 0;
+    while ((i < first.size()) || (j < second.size()))
+    {
+        if ((j == second.size()) || ((i < first.size()) && (first[i].begin < second[j].begin)))
+        {
+            appendRun(dst, first[i].begin, first[i].end);
+            ++i;
+        }
+        else
+        {
+            appendRun(dst, second[j].begin, second[j].end);
+            ++j;
+        }
+    }
+
+    return;
+}
+
+RunMask::RunMask()
+:size_(), runs_(), rows_(1, 0)
+{
+}
+
+RunMask::RunMask(const Mat& image)
+:RunMask()
+{
+    fromMat(image);
+}
+
+void RunMask::fromMat(const Mat& image)
+{
+    CV_Assert(image.type() == CV_8UC1);
+
+    size_ = image.size();
+    runs_.clear();
+    rows_.resize(size_.height + 1);
+    rows_[0] = 0;
+    for (int y = 0; y < size_.height; ++y)
+    {
+        const uchar* ptr = image.ptr(y);
+        int x = 0;
+        while (x < size_.width)
+        {
+            if (ptr[x] != ForeGround)
+            {
+                ++x;
+                continue;
+            }
+
+            const int begin = x;
+            while ((x < size_.width) && (ptr[x] == ForeGround))
+                ++x;
+
+            runs_.push_back({ begin, x });
+        }
+
+        rows_[y + 1] = (int)runs_.size();
+    }
+
+    return;
+}
+
+void RunMask::toMat(Mat& image) const
+{
+    image.create(size_, CV_8UC1);
+    for (int y = 0; y < size_.height; ++y)
+    {
+        uchar* ptr = image.ptr(y);
+        memset(ptr, BackGround, size_.width);
+        for (const Run* run = rowBegin(y); run != rowEnd(y); ++run)
+            memset(ptr + run->begin, ForeGround, run->end - run->begin);
+    }
+
+    return;
+}
+
+Size RunMask::size() const
+{
+    return size_;
+}
+
+bool RunMask::empty() const
+{
+    return size_.area() == 0;
+}
+
+const Run* RunMask::rowBegin(int y) const
+{
+    return runs_.data() + rows_[y];
+}
+
+const Run* RunMask::rowEnd(int y) const
+{
+    return runs_.data() + rows_[y + 1];
+}
+
+template <typename RowOperation>
+void RunMask::transformRows(RowOperation operation)
+{
+    // Операция получает пустой список серий строки, поэтому
+    // серии разных строк никогда не объединяются.
+    vector<Run> runs, row;
+    vector<int> rows(size_.height + 1, 0);
+    for (int y = 0; y < size_.height; ++y)
+    {
+        row.clear();
+        operation(y, row);
+        runs.insert(runs.end(), row.begin(), row.end());
+        rows[y + 1] = (int)runs.size();
+    }
+
+    runs_.swap(runs);
+    rows_.swap(rows);
+    return;
+}
+
+void RunMask::dilateCross(int iterations)
+{
+    // Повторная дилатация крестом равна дилатации ромбом радиуса iterations.
+    const int cols = size_.width, rows = size_.height;
+    const RunMask source(*this);
+
+    vector<Run> accumulated, grown, united;
+    transformRows([&](int y, vector<Run>& dst)
+    {
+        accumulated.clear();
+        for (int dy = -iterations; dy <= iterations; ++dy)
+        {
+            const int row = y + dy;
+            if ((row < 0) || (row >= rows))
+                continue;
+
+            const int radius = iterations - std::abs(dy);
+            grown.clear();
+            growRuns(source.rowBegin(row), source.rowEnd(row), radius, radius, cols, grown);
+            united.clear();
+            uniteRuns(accumulated, grown, united);
+            accumulated.swap(united);
+        }
+
+        dst.insert(dst.end(), accumulated.begin(), accumulated.end());
+    });
+
+    return;
+}
@@ -0,0 +1,31 @@
+﻿/*
+    Реализация объединения непересекающихся множеств.
+*/
+
+#include <utility>
+
+#include <UnionFind.h>
+
+using namespace std;
+
+int findRoot(int label, vector<int>& parents)
+{
+    while (parents[label] != label)
+    {
+        parents[label] = parents[parents[label]];
+        label = parents[label];
+    }
+
+    return label;
+}
+
+int mergeSets(int first, int second, vector<int>& parents)
+{
+    int parent = findRoot(first, parents);
+    int child = findRoot(second, parents);
+    if (child < parent)
+        std::swap(parent, child);
+
+    parents[child] = parent;
+    return parent;
+}
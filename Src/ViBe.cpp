@@ -2,40 +2,92 @@
     Реализация алгоритма сегментации движения ViBe.
 */
 
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <math.h>
+#include <opencv2/core/hal/intrin.hpp>
+#include <opencv2/imgproc.hpp>
+
 #include <ViBe.h>
 
 using namespace cv;
+using namespace std;
 
 const uchar BackGround = 0;
 const uchar ForeGround = 255;
 
-ViBe::ViBe()
-:history_depth_(20), sqr_rad_(20 * 20), min_overlap_(2), probability_(16),
-initialized_(false), samples_(), generator_()
+// Вес квадрата разности квантованной цветности в компактной модели
+// (шаг квантования равен 16 уровням).
+const int CompactChromaScale = 16 * 16;
+
+// Размер таблиц случайных чисел (степень двойки).
+const unsigned RandomTableSize = 1 << 14;
+
+// Смещения до точек восьмисвязной области.
+static const Point2i neibors[8] = {
+    {-1, -1}, {0, -1}, {1, -1},
+    {-1,  0},          {1,  0},
+    {-1,  1}, {0,  1}, {1,  1} };
+
+// Количество точек, пропускаемых до следующего обновления, когда каждая точка
+// обновляется с вероятностью 1 / probability (геометрическое распределение).
+// uniform - квантиль распределения из (0, 1].
+static int getGeometricSkip(double uniform, int probability)
 {
+    if (probability <= 1)
+        return 0;
+
+    const double skip = log(uniform) / log(1.0 - 1.0 / probability);
+    return (int)min(skip, (double)USHRT_MAX);
 }
 
-ViBe::ViBe(int history_depth, int rad, int min_overlap, int prob)
-:history_depth_(history_depth), sqr_rad_(rad*rad), min_overlap_(min_overlap),
-probability_(prob), initialized_(false), samples_(), bg_mat_(), generator_()
+// Перемешивание таблицы случайных чисел.
+template <typename T>
+static void shuffleTable(vector<T>& table, RNG& generator)
 {
+    for (size_t i = table.size() - 1; i > 0; --i)
+        std::swap(table[i], table[generator.uniform(0, (int)i + 1)]);
 }
 
-ViBe::~ViBe()
+// Яркость Y точки BGR. Коэффициенты и округление совпадают
+// с целочисленными преобразованиями COLOR_BGR2GRAY и COLOR_BGR2YCrCb.
+static inline int computeLuma(int b, int g, int r)
 {
-    if (samples_.empty() == true)
-        return;
+    return (b * 1868 + g * 9617 + r * 4899 + (1 << 13)) >> 14;
+}
 
-    for (int y = 0; y < samples_.rows; ++y)
+// Количество байт на одно значение модели.
+static int getModelChannels(ViBeModel model)
+{
+    switch (model)
     {
-        for (int x = 0; x < samples_.cols; ++x)
-        {
-            delete[] samples_(y, x);
-        }
+        case ViBeModel::Color:
+            return 3;
+        case ViBeModel::Luma:
+            return 1;
+        case ViBeModel::Compact:
+            return 2;
+        default:
+            throw;
     }
+}
+
+ViBe::ViBe()
+:history_depth_(20), sqr_rad_(20 * 20), min_overlap_(2), probability_(16),
+model_(ViBeModel::Color), channels_(getModelChannels(model_)),
+initialized_(false), samples_(), size_(), frame_(), bg_mat_(), bg_luma_(), bg_luma_sum_(0),
+streams_(1), tile_size_(0), tile_threshold_(0), tiles_total_(0), tiles_skipped_(0)
+{
+}
 
-    samples_.release();
-    bg_mat_.release();
+ViBe::ViBe(int history_depth, int rad, int min_overlap, int prob, ViBeModel model)
+:history_depth_(history_depth), sqr_rad_(rad*rad), min_overlap_(min_overlap),
+probability_(prob), model_(model), channels_(getModelChannels(model_)),
+initialized_(false), samples_(), size_(), frame_(), bg_mat_(), bg_luma_(), bg_luma_sum_(0),
+streams_(1), tile_size_(0), tile_threshold_(0), tiles_total_(0), tiles_skipped_(0)
+{
 }
 
 void ViBe::apply(const InputArray &image, OutputArray &fgmask, double)
@@ -56,158 +108,998 @@ void ViBe::getBackgroundImage(cv::OutputArray &image) const
     return;
 }
 
+const Mat& ViBe::getBackground() const
+{
+    return bg_mat_;
+}
+
+const Mat& ViBe::getBackgroundLuma() const
+{
+    return bg_luma_;
+}
+
+int64 ViBe::getBackgroundLumaSum() const
+{
+    return bg_luma_sum_;
+}
+
+void ViBe::computeBackgroundLuma()
+{
+    bg_luma_.create(bg_mat_.size(), CV_8U);
+    bg_luma_sum_ = 0;
+    for (int y = 0; y < bg_mat_.rows; ++y)
+    {
+        const uchar* src = bg_mat_.ptr(y);
+        uchar* dst = bg_luma_.ptr(y);
+        int64 row_sum = 0;
+        for (int x = 0; x < bg_mat_.cols; ++x)
+        {
+            dst[x] = (uchar)computeLuma(src[3 * x], src[3 * x + 1], src[3 * x + 2]);
+            row_sum += dst[x];
+        }
+        bg_luma_sum_ += row_sum;
+    }
+
+    return;
+}
+
+size_t ViBe::getModelMemory() const
+{
+    return samples_.total() * samples_.elemSize();
+}
+
+void ViBe::setActivityGate(int tile_size, int threshold)
+{
+    CV_Assert(tile_size >= 0);
+
+    tile_size_ = tile_size;
+    tile_threshold_ = threshold;
+    tiles_.release();
+    reference_.release();
+    tiles_total_ = 0;
+    tiles_skipped_ = 0;
+    return;
+}
+
+double ViBe::getSkippedTileFraction() const
+{
+    return (tiles_total_ > 0) ? (double)tiles_skipped_ / tiles_total_ : 0.0;
+}
+
+void ViBe::setParallelism(int bands_number, uint64 seed)
+{
+    CV_Assert(bands_number > 0);
+
+    // Состояния генераторов полос берутся из общего генератора,
+    // чтобы последовательности разных полос не были связаны.
+    RNG master(seed);
+    streams_.resize(bands_number);
+    for (auto& stream : streams_)
+    {
+        uint64 state = master.next();
+        state = (state << 32) | master.next();
+        stream.generator = RNG(state);
+        resetStream(stream);
+    }
+
+    return;
+}
+
+// Формат файла модели: заголовок, состояния полос, таблицы случайных чисел,
+// значения модели и изображение фона. Поля записываются в порядке байтов
+// платформы. Значения модели и фон хранятся так же, как в памяти, и начинаются
+// со смещений, кратных ModelFileAlignment, поэтому файл можно отображать в память.
+const char ModelFileMagic[4] = { 'V', 'I', 'B', 'E' };
+const uint32_t ModelFileVersion = 1;
+const uint64_t ModelFileAlignment = 4096;
+
+struct ModelFileHeader
+{
+    char magic[4];
+    uint32_t version;
+    int32_t width;
+    int32_t height;
+    int32_t history_depth;
+    int32_t sqr_rad;
+    int32_t min_overlap;
+    int32_t probability;
+    int32_t model;
+    int32_t streams_number;
+    uint32_t table_size;
+    uint32_t reserved;
+    uint64_t samples_offset;
+    uint64_t samples_size;
+    uint64_t background_offset;
+    uint64_t background_size;
+};
+
+struct ModelFileStream
+{
+    uint64_t state;
+    uint32_t position;
+    int32_t pixel_skip;
+    int32_t neibor_skip;
+    int32_t reserved;
+};
+
+// Максимальное количество полос, принимаемое при загрузке модели.
+const int MaxModelFileStreams = 4096;
+// Максимальная ширина и высота модели, принимаемые при загрузке.
+const int MaxModelFileSide = 1 << 14;
+
+static uint64_t alignFileOffset(uint64_t offset)
+{
+    return (offset + ModelFileAlignment - 1) / ModelFileAlignment * ModelFileAlignment;
+}
+
+// Смещение первого байта после таблиц случайных чисел.
+static uint64_t getTablesEnd(int streams_number)
+{
+    return sizeof(ModelFileHeader) + streams_number * sizeof(ModelFileStream) +
+           RandomTableSize * (2 * sizeof(ushort) + sizeof(uchar));
+}
+
+// Дополнение файла нулями до смещения offset.
+static void writePadding(ofstream& file, uint64_t offset)
+{
+    const vector<char> zeros((size_t)(offset - (uint64_t)file.tellp()), 0);
+    file.write(zeros.data(), zeros.size());
+    return;
+}
+
+bool ViBe::save(const string& filename) const
+{
+    if (samples_.empty())
+        return false;
+    CV_Assert(samples_.isContinuous() && bg_mat_.isContinuous());
+
+    ModelFileHeader header = {};
+    memcpy(header.magic, ModelFileMagic, sizeof(header.magic));
+    header.version = ModelFileVersion;
+    header.width = size_.width;
+    header.height = size_.height;
+    header.history_depth = history_depth_;
+    header.sqr_rad = sqr_rad_;
+    header.min_overlap = min_overlap_;
+    header.probability = probability_;
+    header.model = (int32_t)model_;
+    header.streams_number = (int32_t)streams_.size();
+    header.table_size = RandomTableSize;
+    header.samples_offset = alignFileOffset(getTablesEnd(header.streams_number));
+    header.samples_size = samples_.total() * samples_.elemSize();
+    header.background_offset = alignFileOffset(header.samples_offset + header.samples_size);
+    header.background_size = bg_mat_.total() * bg_mat_.elemSize();
+
+    ofstream file(filename, ios::binary);
+    file.write((const char*)&header, sizeof(header));
+    for (const auto& stream : streams_)
+    {
+        ModelFileStream record = {};
+        record.state = stream.generator.state;
+        record.position = stream.position;
+        record.pixel_skip = stream.pixel_skip;
+        record.neibor_skip = stream.neibor_skip;
+        file.write((const char*)&record, sizeof(record));
+    }
+    file.write((const char*)sample_table_.data(), sample_table_.size() * sizeof(ushort));
+    file.write((const char*)neibor_table_.data(), neibor_table_.size() * sizeof(uchar));
+    file.write((const char*)skip_table_.data(), skip_table_.size() * sizeof(ushort));
+
+    writePadding(file, header.samples_offset);
+    file.write((const char*)samples_.data, header.samples_size);
+    writePadding(file, header.background_offset);
+    file.write((const char*)bg_mat_.data, header.background_size);
+
+    return file.good();
+}
+
+bool ViBe::load(const string& filename, const Size& frame_size)
+{
+    ifstream file(filename, ios::binary);
+    ModelFileHeader header;
+    file.seekg(0, ios::end);
+    const streamoff file_size = file.tellg();
+    file.seekg(0, ios::beg);
+    if (!file || !file.read((char*)&header, sizeof(header)) ||
+        (memcmp(header.magic, ModelFileMagic, sizeof(header.magic)) != 0) ||
+        (header.version != ModelFileVersion))
+        return false;
+
+    // Проверка согласованности заголовка.
+    if ((header.width <= 0) || (header.width > MaxModelFileSide) ||
+        (header.height <= 0) || (header.height > MaxModelFileSide) ||
+        (header.history_depth <= 0) || (header.history_depth > USHRT_MAX) ||
+        ((int64_t)header.history_depth * ((int64_t)header.height + 2) > INT_MAX) ||
+        (header.sqr_rad < 0) || (header.sqr_rad > USHRT_MAX) ||
+        (header.min_overlap < 0) || (header.min_overlap > header.history_depth) ||
+        (header.probability <= 0) ||
+        (header.model < (int32_t)ViBeModel::Color) || (header.model > (int32_t)ViBeModel::Compact) ||
+        (header.streams_number <= 0) || (header.streams_number > MaxModelFileStreams) ||
+        (header.table_size != RandomTableSize))
+        return false;
+
+    const ViBeModel model = (ViBeModel)header.model;
+    const int channels = getModelChannels(model);
+    const uint64_t samples_size = (uint64_t)header.history_depth * ((uint64_t)header.height + 2) *
+                                  ((uint64_t)header.width + 2) * channels;
+    const uint64_t background_size = (uint64_t)header.height * header.width * 3;
+    if ((header.samples_size != samples_size) || (header.background_size != background_size))
+        return false;
+
+    // Области данных должны идти по порядку и помещаться в файл. Разности
+    // вместо сумм исключают переполнение при произвольных смещениях.
+    if ((header.background_offset > (uint64_t)file_size) ||
+        (background_size > (uint64_t)file_size - header.background_offset) ||
+        (header.samples_offset > header.background_offset) ||
+        (samples_size > header.background_offset - header.samples_offset) ||
+        (header.samples_offset < getTablesEnd(header.streams_number)))
+        return false;
+
+    vector<ModelFileStream> records(header.streams_number);
+    vector<ushort> sample_table(RandomTableSize);
+    vector<uchar> neibor_table(RandomTableSize);
+    vector<ushort> skip_table(RandomTableSize);
+    file.read((char*)records.data(), records.size() * sizeof(ModelFileStream));
+    file.read((char*)sample_table.data(), sample_table.size() * sizeof(ushort));
+    file.read((char*)neibor_table.data(), neibor_table.size() * sizeof(uchar));
+    file.read((char*)skip_table.data(), skip_table.size() * sizeof(ushort));
+
+    Mat samples(header.history_depth * (header.height + 2), header.width + 2, CV_8UC(channels));
+    Mat background(header.height, header.width, CV_8UC3);
+    file.seekg(header.samples_offset);
+    file.read((char*)samples.data, samples_size);
+    file.seekg(header.background_offset);
+    file.read((char*)background.data, background_size);
+    if (!file)
+        return false;
+
+    // Расстояния до обновляемых точек не превосходят USHRT_MAX, отрицательное
+    // расстояние привело бы к обращению за пределы строки.
+    for (const auto& record : records)
+    {
+        if ((record.pixel_skip < 0) || (record.pixel_skip > USHRT_MAX) ||
+            (record.neibor_skip < 0) || (record.neibor_skip > USHRT_MAX))
+            return false;
+    }
+
+    // Индексы из таблиц используются без проверок, поэтому проверяем их здесь.
+    for (unsigned i = 0; i < RandomTableSize; ++i)
+    {
+        if ((sample_table[i] >= header.history_depth) || (neibor_table[i] >= 8))
+            return false;
+    }
+
+    history_depth_ = header.history_depth;
+    sqr_rad_ = header.sqr_rad;
+    min_overlap_ = header.min_overlap;
+    probability_ = header.probability;
+    model_ = model;
+    channels_ = channels;
+    size_ = Size(header.width, header.height);
+    samples_ = samples;
+    bg_mat_ = background;
+    computeBackgroundLuma();
+    frame_.release();
+    reference_.release();
+    sample_table_.swap(sample_table);
+    neibor_table_.swap(neibor_table);
+    skip_table_.swap(skip_table);
+
+    streams_.resize(records.size());
+    for (size_t i = 0; i < records.size(); ++i)
+    {
+        streams_[i].generator.state = records[i].state;
+        streams_[i].position = records[i].position;
+        streams_[i].pixel_skip = records[i].pixel_skip;
+        streams_[i].neibor_skip = records[i].neibor_skip;
+    }
+
+    initialized_ = true;
+    if (!frame_size.empty() && (getModelSize(frame_size) != size_))
+        resample(getModelSize(frame_size));
+    finishLoad(frame_size);
+
+    return true;
+}
+
+void ViBe::finishLoad(const Size&)
+{
+    return;
+}
+
+void ViBe::resample(const Size& frame_size)
+{
+    // Значения модели не интерполируются, а берутся из ближайших точек,
+    // поэтому в модели остаются только значения, наблюдавшиеся в кадрах.
+    Mat samples(history_depth_ * (frame_size.height + 2), frame_size.width + 2, samples_.type());
+    for (int k = 0; k < history_depth_; ++k)
+    {
+        const Mat plane = samples_.rowRange(k * (size_.height + 2), (k + 1) * (size_.height + 2));
+        Mat resized, bordered;
+        resize(plane(Rect(1, 1, size_.width, size_.height)), resized, frame_size, 0, 0, INTER_NEAREST);
+        copyMakeBorder(resized, bordered, 1, 1, 1, 1, BORDER_REPLICATE);
+
+        Mat resampled_plane = samples.rowRange(k * (frame_size.height + 2), (k + 1) * (frame_size.height + 2));
+        bordered.copyTo(resampled_plane);
+    }
+
+    Mat background;
+    resize(bg_mat_, background, frame_size, 0, 0, INTER_LINEAR);
+
+    samples_ = samples;
+    bg_mat_ = background;
+    computeBackgroundLuma();
+    size_ = frame_size;
+    return;
+}
+
+int ViBe::getBandsNumber() const
+{
+    // Полоса должна содержать хотя бы две строки, иначе соседи
+    // полос одной чётности будут пересекаться.
+    return std::max(1, std::min((int)streams_.size(), size_.height / 2));
+}
+
+void ViBe::processBands(const std::function<void(UpdateStream&, int, int)>& body, bool separate_neighbors)
+{
+    const int bands_number = getBandsNumber();
+    if (bands_number == 1)
+    {
+        body(streams_[0], 0, size_.height);
+        return;
+    }
+
+    const int passes = separate_neighbors ? 2 : 1;
+    for (int pass = 0; pass < passes; ++pass)
+    {
+        const int bands_in_pass = (bands_number - pass + passes - 1) / passes;
+        parallel_for_(Range(0, bands_in_pass), [&](const Range& range)
+        {
+            for (int i = range.start; i < range.end; ++i)
+            {
+                const int band = i * passes + pass;
+                const int y_begin = size_.height * band / bands_number;
+                const int y_end = size_.height * (band + 1) / bands_number;
+                body(streams_[band], y_begin, y_end);
+            }
+        }, bands_in_pass);
+    }
+
+    return;
+}
+
+void ViBe::buildRandomTables(RNG& generator)
+{
+    // Таблицы заполняются равномерно по квантилям и перемешиваются,
+    // поэтому распределения значений в них точно соответствуют заданным.
+    sample_table_.resize(RandomTableSize);
+    neibor_table_.resize(RandomTableSize);
+    skip_table_.resize(RandomTableSize);
+    for (unsigned i = 0; i < RandomTableSize; ++i)
+    {
+        sample_table_[i] = (ushort)(i % history_depth_);
+        neibor_table_[i] = (uchar)(i % 8);
+        skip_table_[i] = (ushort)getGeometricSkip((i + 0.5) / RandomTableSize, probability_);
+    }
+
+    shuffleTable(sample_table_, generator);
+    shuffleTable(neibor_table_, generator);
+    shuffleTable(skip_table_, generator);
+    return;
+}
+
+void ViBe::resetStream(UpdateStream& stream)
+{
+    stream.position = stream.generator.next();
+    stream.pixel_skip = getGeometricSkip(1.0 - stream.generator.uniform(0.0, 1.0), probability_);
+    stream.neibor_skip = getGeometricSkip(1.0 - stream.generator.uniform(0.0, 1.0), probability_);
+    return;
+}
+
+int ViBe::getNextSkip(UpdateStream& stream)
+{
+    return skip_table_[stream.position++ & (RandomTableSize - 1)];
+}
+
 bool ViBe::needToInit()
 {
     return !initialized_;
 }
 
-void ViBe::initialize(const Mat &image)
+uchar* ViBe::getSample(int k, int y, int x)
 {
-    samples_.release();
-    bg_mat_.release();
-    samples_.create(image.rows, image.cols);
-    bg_mat_.create(image.rows, image.cols, CV_8UC3);
+    return samples_.ptr(k * (size_.height + 2) + y + 1) + channels_ * (x + 1);
+}
 
+// Перевод кадра BGR в компактное представление: яркость Y и цветность Cr, Cb,
+// квантованная до 4 бит и упакованная в один байт. Коэффициенты совпадают с
+// целочисленным преобразованием COLOR_BGR2YCrCb.
+static void convertToCompact(const Mat& image, Mat& compact)
+{
+    compact.create(image.size(), CV_8UC2);
     for (int y = 0; y < image.rows; ++y)
     {
+        const uchar* src = image.ptr(y);
+        uchar* dst = compact.ptr(y);
         for (int x = 0; x < image.cols; ++x)
         {
-            samples_(y, x) = new Point3_<uchar>[history_depth_];
-            // Заполняем первое значение модели значением текущего пикселя.
-            samples_(y, x)[0] = {image.ptr(y)[3 * x],
-                                 image.ptr(y)[3 * x + 1],
-                                 image.ptr(y)[3 * x + 2]};
-
-            //Остальные значения модели заполняем значениями соседних пикселей.
-            for (int k = 1; k < history_depth_; ++k)
+            const int b = src[3 * x], g = src[3 * x + 1], r = src[3 * x + 2];
+            const int luma = computeLuma(b, g, r);
+            const int cr = saturate_cast<uchar>(((r - luma) * 11682 + (128 << 14) + (1 << 13)) >> 14);
+            const int cb = saturate_cast<uchar>(((b - luma) * 9241 + (128 << 14) + (1 << 13)) >> 14);
+            dst[2 * x] = (uchar)luma;
+            dst[2 * x + 1] = (uchar)(((cr >> 4) << 4) | (cb >> 4));
+        }
+    }
+
+    return;
+}
+
+void ViBe::convertFrame(const Mat& image, Mat& converted) const
+{
+    switch (model_)
+    {
+        case ViBeModel::Color:
+            converted = image;
+            break;
+        case ViBeModel::Luma:
+            cvtColor(image, converted, COLOR_BGR2GRAY);
+            break;
+        case ViBeModel::Compact:
+            convertToCompact(image, converted);
+            break;
+    }
+
+    return;
+}
+
+void ViBe::initialize(const Mat &image)
+{
+    size_ = image.size();
+    samples_.create(history_depth_ * (size_.height + 2), size_.width + 2, CV_8UC(channels_));
+    image.copyTo(bg_mat_);
+    computeBackgroundLuma();
+    reference_.release();
+    convertFrame(image, frame_);
+
+    // Изображение с рамкой, из которого берутся значения соседей граничных точек.
+    Mat bordered;
+    copyMakeBorder(frame_, bordered, 1, 1, 1, 1, BORDER_REPLICATE);
+
+    for (int k = 0; k < history_depth_; ++k)
+    {
+        // Заполняем плоскость модели значениями текущего кадра вместе с рамкой.
+        Mat plane = samples_.rowRange(k * (size_.height + 2), (k + 1) * (size_.height + 2));
+        bordered.copyTo(plane);
+    }
+
+    buildRandomTables(streams_[0].generator);
+    for (auto& stream : streams_)
+        resetStream(stream);
+
+    // Остальные значения модели заполняем значениями соседних пикселей.
+    processBands([&](UpdateStream& stream, int y_begin, int y_end)
+    {
+        for (int k = 1; k < history_depth_; ++k)
+        {
+            for (int y = y_begin; y < y_end; ++y)
             {
-                Point2i neib_pixel = getRandomNeiborPixel(Point2i(x, y));
-                samples_(y, x)[k] = {
-                    image.ptr(neib_pixel.y)[3 * neib_pixel.x],
-                    image.ptr(neib_pixel.y)[3 * neib_pixel.x + 1],
-                    image.ptr(neib_pixel.y)[3 * neib_pixel.x + 2]};
+                uchar* sample = getSample(k, y, 0);
+                for (int x = 0; x < image.cols; ++x)
+                {
+                    Point2i neib_pixel = getRandomNeiborPixel(Point2i(x, y), stream.generator);
+                    const uchar* value = bordered.ptr(neib_pixel.y + 1) + channels_ * (neib_pixel.x + 1);
+                    for (int c = 0; c < channels_; ++c)
+                        sample[channels_ * x + c] = value[c];
+                }
             }
-
-            // Значение фона равно значению текущего пикселя.
-            bg_mat_.ptr(y)[3 * x]     = image.ptr(y)[3 * x];
-            bg_mat_.ptr(y)[3 * x + 1] = image.ptr(y)[3 * x + 1];
-            bg_mat_.ptr(y)[3 * x + 2] = image.ptr(y)[3 * x + 2];
         }
-    }
+    }, false);
 
     initialized_ = true;
     return;
 }
 
-// Функция, вычисляющая квадрат расстояния между двумя точками.
-static double computeDistanceSqr(const Point3_<uchar> &pixel,
-    const Point3_<uchar> &sample)
+// Функция, вычисляющая квадрат расстояния между двумя точками BGR.
+static int computeDistanceSqr(const uchar* pixel, const uchar* sample)
 {
-    double sum = 0;
-    sum += (pixel.x - sample.x) * (pixel.x - sample.x);
-    sum += (pixel.y - sample.y) * (pixel.y - sample.y);
-    sum += (pixel.z - sample.z) * (pixel.z - sample.z);
+    int sum = 0;
+    sum += (pixel[0] - sample[0]) * (pixel[0] - sample[0]);
+    sum += (pixel[1] - sample[1]) * (pixel[1] - sample[1]);
+    sum += (pixel[2] - sample[2]) * (pixel[2] - sample[2]);
     return sum;
 }
 
+// Функция, вычисляющая квадрат расстояния между значениями яркости.
+static int computeLumaDistanceSqr(const uchar* pixel, const uchar* sample)
+{
+    return (pixel[0] - sample[0]) * (pixel[0] - sample[0]);
+}
+
+// Функция, вычисляющая квадрат расстояния между компактными значениями.
+static int computeCompactDistanceSqr(const uchar* pixel, const uchar* sample)
+{
+    const int luma = pixel[0] - sample[0];
+    const int cr = (pixel[1] >> 4) - (sample[1] >> 4);
+    const int cb = (pixel[1] & 15) - (sample[1] & 15);
+    return luma * luma + CompactChromaScale * (cr * cr + cb * cb);
+}
+
+// Параметры классификации точек одной строки.
+struct RowModel
+{
+    const uchar* model; // Значения первой плоскости модели в начале строки.
+    size_t plane_step; // Расстояние между соседними плоскостями модели.
+    int history_depth;
+    int sqr_rad;
+    int min_overlap;
+};
+
+// Скалярная классификация значения value по модели точки x строки.
+template <int channels, int (*distance)(const uchar*, const uchar*)>
+static uchar segmentPixel(const RowModel& row, const uchar* value, int x)
+{
+    // Находим количество пересечений текущего значения пикселя с моделью.
+    int counter = 0;
+    for (int i = 0; i < row.history_depth; ++i)
+    {
+        const uchar* sample = row.model + i * row.plane_step + channels * x;
+        int dist = distance(value, sample);
+        if (dist < row.sqr_rad)
+        {
+            counter++;
+            if (counter >= row.min_overlap)
+                break;
+        }
+    }
+
+    if (counter >= row.min_overlap)
+        return BackGround;
+    else
+        return ForeGround;
+}
+
+// Скалярная классификация точек [x_begin, x_end) строки.
+template <int channels, int (*distance)(const uchar*, const uchar*)>
+static void segmentPixels(const RowModel& row, const uchar* src, int x_begin, int x_end, uchar* dst)
+{
+    for (int x = x_begin; x < x_end; ++x)
+        dst[x] = segmentPixel<channels, distance>(row, src + channels * x, x);
+
+    return;
+}
+
+#if CV_SIMD
+// Векторное вычисление квадратов расстояний для v_uint8::nlanes точек.
+// Сложение 16-битных чисел выполняется с насыщением, поэтому значения,
+// большие USHRT_MAX, ограничиваются сверху.
+struct ColorKernel
+{
+    enum { channels = 3 };
+    v_uint8 b, g, r;
+
+    explicit ColorKernel(const uchar* pixels)
+    {
+        v_load_deinterleave(pixels, b, g, r);
+    }
+
+    void computeDistanceSqr(const uchar* samples, v_uint16& dist_lo, v_uint16& dist_hi) const
+    {
+        v_uint8 sample_b, sample_g, sample_r;
+        v_load_deinterleave(samples, sample_b, sample_g, sample_r);
+
+        v_uint16 b_lo, b_hi, g_lo, g_hi, r_lo, r_hi;
+        v_expand(v_absdiff(b, sample_b), b_lo, b_hi);
+        v_expand(v_absdiff(g, sample_g), g_lo, g_hi);
+        v_expand(v_absdiff(r, sample_r), r_lo, r_hi);
+
+        dist_lo = v_mul_wrap(b_lo, b_lo) + v_mul_wrap(g_lo, g_lo) + v_mul_wrap(r_lo, r_lo);
+        dist_hi = v_mul_wrap(b_hi, b_hi) + v_mul_wrap(g_hi, g_hi) + v_mul_wrap(r_hi, r_hi);
+    }
+};
+
+struct LumaKernel
+{
+    enum { channels = 1 };
+    v_uint8 luma;
+
+    explicit LumaKernel(const uchar* pixels)
+    {
+        luma = vx_load(pixels);
+    }
+
+    void computeDistanceSqr(const uchar* samples, v_uint16& dist_lo, v_uint16& dist_hi) const
+    {
+        v_expand(v_absdiff(luma, vx_load(samples)), dist_lo, dist_hi);
+        dist_lo = v_mul_wrap(dist_lo, dist_lo);
+        dist_hi = v_mul_wrap(dist_hi, dist_hi);
+    }
+};
+
+struct CompactKernel
+{
+    enum { channels = 2 };
+    v_uint8 luma;
+    v_uint16 cr_lo, cr_hi, cb_lo, cb_hi;
+
+    explicit CompactKernel(const uchar* pixels)
+    {
+        v_uint8 chroma;
+        v_load_deinterleave(pixels, luma, chroma);
+        splitChroma(chroma, cr_lo, cr_hi, cb_lo, cb_hi);
+    }
+
+    static void splitChroma(const v_uint8& chroma, v_uint16& cr_lo, v_uint16& cr_hi, v_uint16& cb_lo, v_uint16& cb_hi)
+    {
+        const v_uint16 low_bits = vx_setall_u16(15);
+        v_expand(chroma, cb_lo, cb_hi);
+        cr_lo = v_shr<4>(cb_lo);
+        cr_hi = v_shr<4>(cb_hi);
+        cb_lo = cb_lo & low_bits;
+        cb_hi = cb_hi & low_bits;
+    }
+
+    void computeDistanceSqr(const uchar* samples, v_uint16& dist_lo, v_uint16& dist_hi) const
+    {
+        v_uint8 sample_luma, sample_chroma;
+        v_load_deinterleave(samples, sample_luma, sample_chroma);
+        v_uint16 sample_cr_lo, sample_cr_hi, sample_cb_lo, sample_cb_hi;
+        splitChroma(sample_chroma, sample_cr_lo, sample_cr_hi, sample_cb_lo, sample_cb_hi);
+
+        v_uint16 luma_lo, luma_hi;
+        v_expand(v_absdiff(luma, sample_luma), luma_lo, luma_hi);
+        v_uint16 dcr_lo = v_absdiff(cr_lo, sample_cr_lo), dcr_hi = v_absdiff(cr_hi, sample_cr_hi);
+        v_uint16 dcb_lo = v_absdiff(cb_lo, sample_cb_lo), dcb_hi = v_absdiff(cb_hi, sample_cb_hi);
+
+        // Каждое слагаемое цветности не превышает 15 * 15 * 256 и помещается в 16 бит.
+        dist_lo = v_mul_wrap(luma_lo, luma_lo) +
+                  v_shl<8>(v_mul_wrap(dcr_lo, dcr_lo)) + v_shl<8>(v_mul_wrap(dcb_lo, dcb_lo));
+        dist_hi = v_mul_wrap(luma_hi, luma_hi) +
+                  v_shl<8>(v_mul_wrap(dcr_hi, dcr_hi)) + v_shl<8>(v_mul_wrap(dcb_hi, dcb_hi));
+    }
+};
+
+// Векторная классификация точек строки, начиная с x_begin. Возвращает
+// координату первой необработанной точки.
+template <typename Kernel>
+static int segmentPixelsSimd(const RowModel& row, const uchar* src, int x_begin, int x_end, uchar* dst)
+{
+    const v_uint16 v_sqr_rad = vx_setall_u16((ushort)row.sqr_rad);
+    const v_uint16 v_min_overlap = vx_setall_u16((ushort)row.min_overlap);
+    const int step = v_uint8::nlanes;
+    int x = x_begin;
+    for (; x <= x_end - step; x += step)
+    {
+        const Kernel pixels(src + Kernel::channels * x);
+
+        // Счётчики совпадений с моделью для младшей и старшей половин вектора.
+        v_uint16 counter_lo = vx_setzero_u16();
+        v_uint16 counter_hi = vx_setzero_u16();
+        for (int i = 0; i < row.history_depth; ++i)
+        {
+            v_uint16 dist_lo, dist_hi;
+            pixels.computeDistanceSqr(row.model + i * row.plane_step + Kernel::channels * x, dist_lo, dist_hi);
+
+            // Маска сравнения равна 0xFFFF, поэтому вычитание увеличивает счётчик на 1.
+            counter_lo = v_sub_wrap(counter_lo, dist_lo < v_sqr_rad);
+            counter_hi = v_sub_wrap(counter_hi, dist_hi < v_sqr_rad);
+
+            if (v_check_all((counter_lo >= v_min_overlap) & (counter_hi >= v_min_overlap)))
+                break;
+        }
+
+        // Точки с недостаточным количеством совпадений относятся к переднему плану.
+        v_uint8 mask = v_pack(counter_lo < v_min_overlap, counter_hi < v_min_overlap);
+        v_store(dst + x, mask);
+    }
+    vx_cleanup();
+
+    return x;
+}
+#endif // CV_SIMD
+
 void ViBe::getSegmentationMask(const Mat& image, Mat& segmentation_mask)
 {
-    if ((samples_.empty() == 1) || (samples_.rows != image.rows) ||
-        (samples_.cols != image.cols))
+    convertFrame(image, frame_);
+    if ((samples_.empty() == true) || (size_ != image.size()))
     {
         initialized_ = false;
         segmentation_mask.setTo(ForeGround);
         return;
     }
 
-    for (int y = 0; y < image.rows; ++y)
+    if (tile_size_ > 0)
     {
-        const uchar* src = image.ptr(y);
-        uchar* dst = segmentation_mask.ptr(y);
-        for (int x = 0; x < image.cols; ++x)
+        segmentActiveTiles(image, segmentation_mask);
+        return;
+    }
+
+    processBands([&](UpdateStream&, int y_begin, int y_end)
+    {
+        for (int y = y_begin; y < y_end; ++y)
         {
-            // Находим количество пересечений текущего значения пикселя с моделью.
-            int counter = 0;
-            Point3_<uchar> pixel(src[3 * x], src[3 * x + 1], src[3 * x + 2]);
-            for (int i = 0; i < history_depth_; ++i)
+            segmentRow(frame_.ptr(y), y, 0, image.cols, segmentation_mask.ptr(y));
+        }
+    }, false);
+
+    return;
+}
+
+// Состояния блоков карты активности.
+const uchar TileBackground = 0; // Блок классифицирован и не содержит переднего плана.
+const uchar TileForeground = 1; // Блок классифицирован и содержит передний план.
+const uchar TileActive = 2; // Блок классифицируется на текущем кадре.
+
+// Возвращает true, если хотя бы одна компонента точки блока tile изменилась
+// относительно опорного кадра больше чем на threshold.
+static bool isTileChanged(const Mat& image, const Mat& reference, const Rect& tile, int threshold)
+{
+    const int length = tile.width * image.channels();
+    for (int y = tile.y; y < tile.y + tile.height; ++y)
+    {
+        const uchar* src = image.ptr(y) + tile.x * image.channels();
+        const uchar* ref = reference.ptr(y) + tile.x * image.channels();
+        int max_diff = 0;
+        for (int i = 0; i < length; ++i)
+            max_diff = std::max(max_diff, std::abs(src[i] - ref[i]));
+
+        if (max_diff > threshold)
+            return true;
+    }
+
+    return false;
+}
+
+void ViBe::segmentActiveTiles(const Mat& image, Mat& segmentation_mask)
+{
+    const int tile_rows = (size_.height + tile_size_ - 1) / tile_size_;
+    const int tile_cols = (size_.width + tile_size_ - 1) / tile_size_;
+    auto getTile = [&](int ty, int tx)
+    {
+        const int x = tx * tile_size_, y = ty * tile_size_;
+        return Rect(x, y, std::min(tile_size_, size_.width - x), std::min(tile_size_, size_.height - y));
+    };
+
+    // Блок классифицируется заново, если в нём был передний план или он изменился
+    // относительно кадра, на котором был классифицирован в последний раз.
+    // Без опорного кадра классифицируются все блоки.
+    if ((reference_.size() != size_) || (tiles_.size() != Size(tile_cols, tile_rows)))
+    {
+        reference_.create(size_, CV_8UC3);
+        tiles_.create(tile_rows, tile_cols, CV_8U);
+        tiles_.setTo(TileActive);
+    }
+    else
+    {
+        parallel_for_(Range(0, tile_rows), [&](const Range& range)
+        {
+            for (int ty = range.start; ty < range.end; ++ty)
             {
-                Point3_<uchar> model_pixel = samples_(y, x)[i];
-                double dist = computeDistanceSqr(pixel, model_pixel);
-                if (dist < sqr_rad_)
+                uchar* state = tiles_.ptr(ty);
+                for (int tx = 0; tx < tile_cols; ++tx)
                 {
-                    counter++;
-                    if (counter >= min_overlap_)
-                        break;
+                    if ((state[tx] == TileForeground) ||
+                        isTileChanged(image, reference_, getTile(ty, tx), tile_threshold_))
+                        state[tx] = TileActive;
                 }
             }
+        });
 
-            if (counter >= min_overlap_)
-                dst[x] = BackGround;
-            else
-                dst[x] = ForeGround;
-        }
+        tiles_total_ += tiles_.total();
+        tiles_skipped_ += tiles_.total() - countNonZero(tiles_);
     }
 
+    // Точки пропущенных блоков относятся к фону, как и при последней классификации.
+    // Соседние активные блоки строки классифицируются одним вызовом.
+    processBands([&](UpdateStream&, int y_begin, int y_end)
+    {
+        for (int y = y_begin; y < y_end; ++y)
+        {
+            const uchar* state = tiles_.ptr(y / tile_size_);
+            uchar* dst = segmentation_mask.ptr(y);
+            int tx = 0;
+            while (tx < tile_cols)
+            {
+                const bool active = (state[tx] == TileActive);
+                int tx_end = tx + 1;
+                while ((tx_end < tile_cols) && ((state[tx_end] == TileActive) == active))
+                    ++tx_end;
+
+                const int x_begin = tx * tile_size_;
+                const int x_end = std::min(tx_end * tile_size_, size_.width);
+                if (active)
+                    segmentRow(frame_.ptr(y), y, x_begin, x_end, dst);
+                else
+                    memset(dst + x_begin, BackGround, x_end - x_begin);
+                tx = tx_end;
+            }
+        }
+    }, false);
+
+    // Запоминаем результат классификации и опорные значения активных блоков.
+    parallel_for_(Range(0, tile_rows), [&](const Range& range)
+    {
+        for (int ty = range.start; ty < range.end; ++ty)
+        {
+            uchar* state = tiles_.ptr(ty);
+            for (int tx = 0; tx < tile_cols; ++tx)
+            {
+                if (state[tx] != TileActive)
+                    continue;
+
+                const Rect tile = getTile(ty, tx);
+                state[tx] = (countNonZero(segmentation_mask(tile)) > 0) ? TileForeground : TileBackground;
+                Mat reference_tile = reference_(tile);
+                image(tile).copyTo(reference_tile);
+            }
+        }
+    });
+
     return;
 }
 
-void ViBe::updatePixel(const Mat& image, int y, int x)
+void ViBe::segmentRow(const uchar* src, int y, int x_begin, int x_end, uchar* dst)
 {
-    const uchar* src = image.ptr(y);
-    Point3_<uchar> pixel(src[x * 3], src[x * 3 + 1], src[x * 3 + 2]);
+    int x = x_begin;
 
-    int rand_number = generator_.uniform(0, probability_);
-    if (rand_number == 0)
+#if CV_SIMD
+    // Квадраты расстояний считаются в 16-битных беззнаковых числах с насыщением,
+    // поэтому результат совпадает со скалярным только при sqr_rad_ <= USHRT_MAX.
+    if ((sqr_rad_ >= 0) && (sqr_rad_ <= USHRT_MAX) &&
+        (min_overlap_ >= 0) && (min_overlap_ <= USHRT_MAX))
     {
-        rand_number = generator_.uniform(0, history_depth_);
-        samples_(y, x)[rand_number] = pixel;
-        bg_mat_.ptr(y)[3 * x] = pixel.x;
-        bg_mat_.ptr(y)[3 * x + 1] = pixel.y;
-        bg_mat_.ptr(y)[3 * x + 2] = pixel.z;
+        const RowModel row = { getSample(0, y, 0), (size_.height + 2) * samples_.step,
+                               history_depth_, sqr_rad_, min_overlap_ };
+        switch (model_)
+        {
+            case ViBeModel::Color:
+                x = segmentPixelsSimd<ColorKernel>(row, src, x, x_end, dst);
+                break;
+            case ViBeModel::Luma:
+                x = segmentPixelsSimd<LumaKernel>(row, src, x, x_end, dst);
+                break;
+            case ViBeModel::Compact:
+                x = segmentPixelsSimd<CompactKernel>(row, src, x, x_end, dst);
+                break;
+        }
     }
+#endif // CV_SIMD
 
+    segmentRowScalar(src, y, x, x_end, dst);
     return;
 }
 
-void ViBe::updateNeiborPixel(const Mat& image, int y, int x)
+void ViBe::segmentRowScalar(const uchar* src, int y, int x_begin, int x_end, uchar* dst)
 {
-    const uchar* src = image.ptr(y);
-    Point3_<uchar> pixel(src[x * 3], src[x * 3 + 1], src[x * 3 + 2]);
-
-    // Обновление модели случайного соседа из восьмисвязной области.
-    int rand_number = generator_.uniform(0, probability_);
-    if (rand_number == 0)
+    const RowModel row = { getSample(0, y, 0), (size_.height + 2) * samples_.step,
+                           history_depth_, sqr_rad_, min_overlap_ };
+    switch (model_)
     {
-        Point2i neib_pixel = getRandomNeiborPixel(Point2i(x, y));
-        rand_number = generator_.uniform(0, history_depth_);
-        samples_(neib_pixel.y, neib_pixel.x)[rand_number] = pixel;
+        case ViBeModel::Color:
+            segmentPixels<3, computeDistanceSqr>(row, src, x_begin, x_end, dst);
+            break;
+        case ViBeModel::Luma:
+            segmentPixels<1, computeLumaDistanceSqr>(row, src, x_begin, x_end, dst);
+            break;
+        case ViBeModel::Compact:
+            segmentPixels<2, computeCompactDistanceSqr>(row, src, x_begin, x_end, dst);
+            break;
     }
 
     return;
 }
 
-Point2i ViBe::getRandomNeiborPixel(const Point2i &pixel)
+uchar ViBe::segmentValue(const uchar* value, int y, int x)
 {
-    Point2i neib_pixel = { 0 };
-    do
+    const RowModel row = { getSample(0, y, 0), (size_.height + 2) * samples_.step,
+                           history_depth_, sqr_rad_, min_overlap_ };
+    switch (model_)
     {
-        if (pixel.x == 0)
-            neib_pixel.x = generator_.uniform(0, 2);
-        else if (pixel.x == samples_.cols - 1)
-            neib_pixel.x = generator_.uniform(samples_.cols - 2, samples_.cols);
-        else
-            neib_pixel.x = generator_.uniform(pixel.x - 1, pixel.x + 2);
+        case ViBeModel::Color:
+            return segmentPixel<3, computeDistanceSqr>(row, value, x);
+        case ViBeModel::Luma:
+            return segmentPixel<1, computeLumaDistanceSqr>(row, value, x);
+        case ViBeModel::Compact:
+            return segmentPixel<2, computeCompactDistanceSqr>(row, value, x);
+        default:
+            throw;
+    }
+}
 
-        if (pixel.y == 0)
-            neib_pixel.y = generator_.uniform(0, 2);
-        else if (pixel.y == samples_.rows - 1)
-            neib_pixel.y = generator_.uniform(samples_.rows - 2, samples_.rows);
-        else
-            neib_pixel.y = generator_.uniform(pixel.y - 1, pixel.y + 2);
+void ViBe::updatePixel(const Mat& image, int y, int x, UpdateStream& stream)
+{
+    const uchar* src = image.ptr(y) + 3 * x;
+    const uchar* value = frame_.ptr(y) + channels_ * x;
 
-    } while ((neib_pixel.x == pixel.x) && (neib_pixel.y == pixel.y));
+    const int k = sample_table_[stream.position++ & (RandomTableSize - 1)];
+    uchar* sample = getSample(k, y, x);
+    for (int c = 0; c < channels_; ++c)
+        sample[c] = value[c];
+    bg_mat_.ptr(y)[3 * x] = src[0];
+    bg_mat_.ptr(y)[3 * x + 1] = src[1];
+    bg_mat_.ptr(y)[3 * x + 2] = src[2];
 
-    return neib_pixel;
+    // Изменение суммы яркостей копится в полосе и переносится в общую
+    // сумму после обновления, поэтому полосы не пишут в общую переменную.
+    uchar& luma = bg_luma_.ptr(y)[x];
+    const int new_luma = computeLuma(src[0], src[1], src[2]);
+    stream.luma_delta += new_luma - luma;
+    luma = (uchar)new_luma;
+
+    return;
+}
+
+void ViBe::updateNeiborPixel(const Mat&, int y, int x, UpdateStream& stream)
+{
+    const uchar* value = frame_.ptr(y) + channels_ * x;
+
+    // Обновление модели случайного соседа из восьмисвязной области.
+    const Point2i& neibor = neibors[neibor_table_[stream.position++ & (RandomTableSize - 1)]];
+    const int k = sample_table_[stream.position++ & (RandomTableSize - 1)];
+    uchar* sample = getSample(k, y + neibor.y, x + neibor.x);
+    for (int c = 0; c < channels_; ++c)
+        sample[c] = value[c];
+
+    return;
+}
+
+Point2i ViBe::getRandomNeiborPixel(const Point2i &pixel, RNG& generator)
+{
+    // Соседи граничных точек могут попасть на рамку модели,
+    // обновления таких значений ни на что не влияют.
+    return pixel + neibors[generator.uniform(0, 8)];
+}
+
+Size ViBe::getModelSize(const Size& frame_size) const
+{
+    return frame_size;
+}
+
+bool ViBe::allowPropagation(const Mat&, const uchar*, const uchar*, const uchar*, int, int)
+{
+    return true;
+}
+
+void ViBe::beginUpdate(const Mat&)
+{
+    for (auto& stream : streams_)
+        stream.luma_delta = 0;
+
+    return;
+}
+
+void ViBe::finishUpdate()
+{
+    for (const auto& stream : streams_)
+        bg_luma_sum_ += stream.luma_delta;
+
+    return;
+}
+
+void ViBe::updateRow(const Mat& image, const uchar* top, const uchar* mask, const uchar* bottom,
+                     int y, UpdateStream& stream)
+{
+    // Каждая строка начинается со случайной позиции в таблицах,
+    // чтобы последовательности не повторялись от строки к строке.
+    stream.position = stream.generator.next();
+
+    int x = stream.pixel_skip;
+    for (; x < image.cols; x += getNextSkip(stream) + 1)
+    {
+        if (mask[x] == BackGround)
+            updatePixel(image, y, x, stream);
+    }
+    stream.pixel_skip = x - image.cols;
+
+    x = stream.neibor_skip;
+    for (; x < image.cols; x += getNextSkip(stream) + 1)
+    {
+        if (mask[x] == BackGround && allowPropagation(image, top, mask, bottom, y, x))
+            updateNeiborPixel(image, y, x, stream);
+    }
+    stream.neibor_skip = x - image.cols;
+
+    return;
 }
 
 void ViBe::update(const Mat& image, const Mat& update_mask)
@@ -218,18 +1110,22 @@ void ViBe::update(const Mat& image, const Mat& update_mask)
         return;
     }
 
-    for (int y = 0; y < image.rows; ++y)
+    // Каждая точка фона обновляет свою модель и модель соседа с вероятностью
+    // 1 / probability_. Вместо розыгрыша в каждой точке перебираются только
+    // выбранные точки: расстояния между ними имеют геометрическое распределение.
+    // Выбранные точки переднего плана пропускаются, что не меняет вероятность
+    // обновления точек фона.
+    beginUpdate(image);
+    processBands([&](UpdateStream& stream, int y_begin, int y_end)
     {
-        const uchar* mask = update_mask.ptr(y);
-        for (int x = 0; x < image.cols; ++x)
+        for (int y = y_begin; y < y_end; ++y)
         {
-            if (mask[x] != BackGround)
-                continue;
-
-            updatePixel(image, y, x);
-            updateNeiborPixel(image, y, x);
+            const uchar* top = (y > 0) ? update_mask.ptr(y - 1) : nullptr;
+            const uchar* bottom = (y < image.rows - 1) ? update_mask.ptr(y + 1) : nullptr;
+            updateRow(image, top, update_mask.ptr(y), bottom, y, stream);
         }
-    }
+    }, true);
+    finishUpdate();
 
     return;
 }
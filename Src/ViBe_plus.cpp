@@ -2,6 +2,11 @@
     Реализация алгоритма сегментации движения ViBe_plus.
 */
 
+#include <algorithm>
+#include <cstring>
+#include <opencv2/core/hal/intrin.hpp>
+#include <opencv2/imgproc.hpp>
+
 #include <ViBe_plus.h>
 
 #include <deletenoise.h>
@@ -11,13 +16,23 @@ using namespace cv;
 const uchar BackGround = 0;
 const uchar ForeGround = 255;
 
-ViBe_plus::ViBe_plus() : ViBe()
+// Порог квадрата градиента, выше которого точка считается границей объекта.
+const double MaxGradientSqr = 2500;
+
+// Минимальные площади областей масок.
+const int MinObjectArea = 100; // Объекты маски движения.
+const int MinHoleArea = 200; // Дыры в объектах маски движения.
+const int MinUpdateHoleArea = 51; // Дыры в объектах маски обновления модели.
+
+ViBe_plus::ViBe_plus() : ViBe(), scale_(1)
 {
 }
 
-ViBe_plus::ViBe_plus(int history_depth, int radius, int min_overlap, int probability)
-:ViBe(history_depth, radius, min_overlap, probability)
+ViBe_plus::ViBe_plus(int history_depth, int radius, int min_overlap, int probability,
+                     ViBeModel model, int scale)
+:ViBe(history_depth, radius, min_overlap, probability, model), scale_(scale)
 {
+    CV_Assert(scale_ > 0);
 }
 
 void ViBe_plus::apply(const InputArray &image, OutputArray &fgmask, double)
@@ -25,81 +40,272 @@ void ViBe_plus::apply(const InputArray &image, OutputArray &fgmask, double)
     const Mat image_ = image.getMat();
     fgmask.create(image_.rows, image_.cols, CV_8U);
     Mat fgmask_ = fgmask.getMat();
+    frame_size_ = image_.size();
+
+    if (scale_ == 1)
+    {
+        getSegmentationMask(image_, fgmask_);
+        filterAndUpdate(image_, fgmask_);
+        return;
+    }
 
-    getSegmentationMask(image_, fgmask_);
+    // Сегментация и обновление модели выполняются на уменьшенном кадре,
+    // пороги площадей шумовых областей уменьшаются пропорционально.
+    resize(image_, small_image_, getModelSize(frame_size_), 0, 0, INTER_AREA);
+    small_mask_.create(small_image_.size(), CV_8U);
+    getSegmentationMask(small_image_, small_mask_);
 
-    Mat update_mask = fgmask_.clone();
-    deleteNoise(fgmask_, 100, 200);
-    deleteNoise(update_mask, 0, 51);
+    refineMask(image_, fgmask_);
+    deleteNoise(fgmask_, MinObjectArea, MinHoleArea);
 
-    update(image_, update_mask);
+    Mat update_mask = small_mask_.clone();
+    deleteNoise(update_mask, 0, MinUpdateHoleArea / (scale_ * scale_));
+    update(small_image_, update_mask);
     return;
 }
 
-// Вычисление квадрата градиента в заданной точке изображения.
-static double computeGradientSqr(const Mat& image, int y, int x)
+void ViBe_plus::filterAndUpdate(const Mat& image, Mat& mask)
 {
-    const uchar* top = image.ptr(y + 1);
-    const uchar* current = image.ptr(y);
-    const uchar* bottom = image.ptr(y - 1);
+    // Маска сегментации размечается один раз, по этой разметке строятся
+    // и маска обновления, и отфильтрованная маска движения. Разметка, запись
+    // масок и обновление модели выполняются параллельно по полосам строк.
+    if (mask.empty())
+        return;
 
-    // Переводим окрестность точки в градации серого.
-    double gray[3][3] = { 0 };
-    gray[0][0] = 0.114 * top[3 * (x - 1)] + 0.587 * top[3 * (x - 1) + 1] + 0.299 * top[3 * (x - 1) + 2];
-    gray[0][1] = 0.114 * top[3 * x]       + 0.587 * top[3 * x + 1]       + 0.299 * top[3 * x + 2];
-    gray[0][2] = 0.114 * top[3 * (x + 1)] + 0.587 * top[3 * (x + 1) + 1] + 0.299 * top[3 * (x + 1) + 2];
+    components_.apply(mask);
 
-    gray[1][0] = 0.114 * current[3 * (x - 1)] + 0.587 * current[3 * (x - 1) + 1] + 0.299 * current[3 * (x - 1) + 2];
-    gray[1][2] = 0.114 * current[3 * (x + 1)] + 0.587 * current[3 * (x + 1) + 1] + 0.299 * current[3 * (x + 1) + 2];
+    classifyComponents(components_, 0, MinUpdateHoleArea, values_);
+    update_mask_.create(mask.size(), CV_8U);
+    components_.paint(values_, update_mask_);
 
-    gray[2][0] = 0.114 * bottom[3 * (x - 1)] + 0.587 * bottom[3 * (x - 1) + 1] + 0.299 * bottom[3 * (x - 1) + 2];
-    gray[2][1] = 0.114 * bottom[3 * x]       + 0.587 * bottom[3 * x + 1]       + 0.299 * bottom[3 * x + 2];
-    gray[2][2] = 0.114 * bottom[3 * (x + 1)] + 0.587 * bottom[3 * (x + 1) + 1] + 0.299 * bottom[3 * (x + 1) + 2];
+    classifyComponents(components_, MinObjectArea, MinHoleArea, values_);
+    components_.paint(values_, mask);
 
-    double grad_x = gray[0][2] - gray[0][0];
-    grad_x += 2 * (gray[1][2] - gray[1][0]);
-    grad_x += gray[2][2] - gray[2][0];
+    update(image, update_mask_);
+    return;
+}
 
-    double grad_y = gray[2][0] - gray[0][0];
-    grad_y += 2 * (gray[2][1] - gray[0][1]);
-    grad_y += gray[2][2] - gray[0][2];
+void ViBe_plus::refineMask(const Mat& image, Mat& mask)
+{
+    const int rows = small_mask_.rows, cols = small_mask_.cols;
 
-    double sqr_grad = grad_x * grad_x + grad_y * grad_y;
+    // Граничными считаются точки, у которых хотя бы один сосед
+    // из восьмисвязной области классифицирован иначе.
+    border_.create(small_mask_.size(), CV_8U);
+    bool has_border = false;
+    for (int y = 0; y < rows; ++y)
+    {
+        const uchar* top = small_mask_.ptr(std::max(y - 1, 0));
+        const uchar* current = small_mask_.ptr(y);
+        const uchar* bottom = small_mask_.ptr(std::min(y + 1, rows - 1));
+        uchar* border = border_.ptr(y);
+        for (int x = 0; x < cols; ++x)
+        {
+            const int left = std::max(x - 1, 0), right = std::min(x + 1, cols - 1);
+            const uchar value = current[x];
+            border[x] = (top[left] != value) || (top[x] != value) || (top[right] != value) ||
+                        (current[left] != value) || (current[right] != value) ||
+                        (bottom[left] != value) || (bottom[x] != value) || (bottom[right] != value);
+            has_border = has_border || border[x];
+        }
+    }
 
-    return sqr_grad;
+    // До инициализации модели маска целиком состоит из переднего плана.
+    if (has_border && !needToInit())
+        convertFrame(image, full_frame_);
+    else
+        has_border = false;
+
+    const int channels = full_frame_.empty() ? 0 : full_frame_.channels();
+    for (int y = 0; y < mask.rows; ++y)
+    {
+        const int small_y = y * rows / mask.rows;
+        const uchar* small_mask = small_mask_.ptr(small_y);
+        const uchar* border = border_.ptr(small_y);
+        uchar* dst = mask.ptr(y);
+        for (int x = 0; x < mask.cols; ++x)
+        {
+            const int small_x = x * cols / mask.cols;
+            if (has_border && border[small_x])
+                dst[x] = segmentValue(full_frame_.ptr(y) + channels * x, small_y, small_x);
+            else
+                dst[x] = small_mask[small_x];
+        }
+    }
+
+    return;
 }
 
-void ViBe_plus::update(const Mat& image, const Mat& update_mask)
+void ViBe_plus::getBackgroundImage(OutputArray &image) const
 {
-    if (needToInit())
+    if (scale_ == 1)
     {
-        initialize(image);
+        ViBe::getBackgroundImage(image);
         return;
     }
 
-    for (int y = 0; y < image.rows; ++y)
+    Mat background;
+    ViBe::getBackgroundImage(background);
+    if (background.empty() || frame_size_.empty())
+        background.copyTo(image);
+    else
+        resize(background, image, frame_size_, 0, 0, INTER_LINEAR);
+
+    return;
+}
+
+void ViBe_plus::finishLoad(const Size& frame_size)
+{
+    if (!frame_size.empty())
+        frame_size_ = frame_size;
+    return;
+}
+
+Size ViBe_plus::getModelSize(const Size& frame_size) const
+{
+    return Size(std::max(frame_size.width / scale_, 1), std::max(frame_size.height / scale_, 1));
+}
+
+// Перевод строки BGR в градации серого в тысячных долях: 114 * B + 587 * G + 299 * R.
+static void computeGreyRow(const uchar* src, int cols, int* grey)
+{
+    int x = 0;
+
+#if CV_SIMD
+    const v_uint16 b_weight = vx_setall_u16(114);
+    const v_uint16 g_weight = vx_setall_u16(587);
+    const v_uint16 r_weight = vx_setall_u16(299);
+    auto weigh = [&](const v_uint16& b, const v_uint16& g, const v_uint16& r, int* dst)
+    {
+        v_uint32 b_lo, b_hi, g_lo, g_hi, r_lo, r_hi;
+        v_mul_expand(b, b_weight, b_lo, b_hi);
+        v_mul_expand(g, g_weight, g_lo, g_hi);
+        v_mul_expand(r, r_weight, r_lo, r_hi);
+        v_store(dst, v_reinterpret_as_s32(b_lo + g_lo + r_lo));
+        v_store(dst + v_uint32::nlanes, v_reinterpret_as_s32(b_hi + g_hi + r_hi));
+    };
+
+    for (; x <= cols - v_uint8::nlanes; x += v_uint8::nlanes)
+    {
+        v_uint8 b, g, r;
+        v_load_deinterleave(src + 3 * x, b, g, r);
+
+        v_uint16 b_lo, b_hi, g_lo, g_hi, r_lo, r_hi;
+        v_expand(b, b_lo, b_hi);
+        v_expand(g, g_lo, g_hi);
+        v_expand(r, r_lo, r_hi);
+        weigh(b_lo, g_lo, r_lo, grey + x);
+        weigh(b_hi, g_hi, r_hi, grey + x + v_uint16::nlanes);
+    }
+    vx_cleanup();
+#endif // CV_SIMD
+
+    for (; x < cols; ++x)
+        grey[x] = 114 * src[3 * x] + 587 * src[3 * x + 1] + 299 * src[3 * x + 2];
+
+    return;
+}
+
+// Отмечает внутренние точки строки, квадрат градиента Собеля в которых больше
+// MaxGradientSqr. top, current, bottom - три соседние строки в градациях серого.
+static void markStrongGradient(const int* top, const int* current, const int* bottom, int cols, uchar* flags)
+{
+    // Градации серого хранятся в тысячных долях, поэтому порог умножается на 10^6.
+    // Компоненты градиента меньше 2^24 и переводятся в float без потерь, но квадраты
+    // округляются, поэтому точки с градиентом у самого порога могут классифицироваться иначе.
+    const float threshold = (float)(MaxGradientSqr * 1e6);
+    flags[0] = 0;
+    flags[cols - 1] = 0;
+
+    int x = 1;
+
+#if CV_SIMD
+    const v_float32 v_threshold = vx_setall_f32(threshold);
+    for (; x <= cols - 1 - v_int32::nlanes; x += v_int32::nlanes)
     {
-        const uchar* mask = update_mask.ptr(y);
-        for (int x = 0; x < image.cols; ++x)
+        const v_int32 top_left = vx_load(top + x - 1), top_right = vx_load(top + x + 1);
+        const v_int32 left = vx_load(current + x - 1), right = vx_load(current + x + 1);
+        const v_int32 bottom_left = vx_load(bottom + x - 1), bottom_right = vx_load(bottom + x + 1);
+        const v_int32 top_center = vx_load(top + x), bottom_center = vx_load(bottom + x);
+
+        const v_int32 center_x = right - left, center_y = bottom_center - top_center;
+        const v_int32 grad_x = (top_right - top_left) + center_x + center_x + (bottom_right - bottom_left);
+        const v_int32 grad_y = (bottom_left - top_left) + center_y + center_y + (bottom_right - top_right);
+        const v_float32 float_x = v_cvt_f32(grad_x), float_y = v_cvt_f32(grad_y);
+
+        const v_float32 v_sqr_grad = float_x * float_x + float_y * float_y;
+
+        // Большой градиент встречается редко, поэтому флаги обычно записываются без проверки.
+        if (!v_check_any(v_sqr_grad > v_threshold))
         {
-            if (mask[x] != BackGround)
-                continue;
-
-            updatePixel(image, y, x);
-
-            // Ограничиваем пространственное распространение.
-            if ((y > 0 && y < image.rows - 1 && x > 0 && x < image.cols - 1) &&
-                (mask[x - 1] != BackGround || update_mask.ptr(y - 1)[x] != BackGround ||
-                mask[x + 1] != BackGround || update_mask.ptr(y + 1)[x] != BackGround))
-            {
-                double sqr_grad = computeGradientSqr(image, y, x);
-                if (sqr_grad > 2500)
-                    continue;
-            }
-
-            updateNeiborPixel(image, y, x);
+            memset(flags + x, BackGround, v_float32::nlanes);
+            continue;
         }
+
+        float sqr_grad[v_float32::nlanes];
+        v_store(sqr_grad, v_sqr_grad);
+        for (int i = 0; i < v_float32::nlanes; ++i)
+            flags[x + i] = (sqr_grad[i] > threshold) ? ForeGround : BackGround;
+    }
+    vx_cleanup();
+#endif // CV_SIMD
+
+    for (; x < cols - 1; ++x)
+    {
+        const float grad_x = (float)((top[x + 1] - top[x - 1]) + 2 * (current[x + 1] - current[x - 1]) +
+                                     (bottom[x + 1] - bottom[x - 1]));
+        const float grad_y = (float)((bottom[x - 1] - top[x - 1]) + 2 * (bottom[x] - top[x]) +
+                                     (bottom[x + 1] - top[x + 1]));
+        const float sqr_grad = grad_x * grad_x + grad_y * grad_y;
+        flags[x] = (sqr_grad > threshold) ? ForeGround : BackGround;
     }
 
     return;
 }
+
+void ViBe_plus::beginUpdate(const Mat& image)
+{
+    gradient_.create(image.size(), CV_8U);
+    gradient_rows_.assign(image.rows, 0);
+    grey_.create(image.size(), CV_32S);
+    grey_rows_.assign(image.rows, 0);
+    ViBe::beginUpdate(image);
+    return;
+}
+
+void ViBe_plus::computeGradientRow(const Mat& image, int y)
+{
+    // Строки в градациях серого вычисляются один раз за кадр. Общие строки соседних
+    // полос вычисляются в разных проходах processBands, поэтому гонок нет.
+    for (int i = y - 1; i <= y + 1; ++i)
+    {
+        if (grey_rows_[i] == 0)
+        {
+            computeGreyRow(image.ptr(i), image.cols, grey_.ptr<int>(i));
+            grey_rows_[i] = 1;
+        }
+    }
+
+    markStrongGradient(grey_.ptr<int>(y - 1), grey_.ptr<int>(y), grey_.ptr<int>(y + 1),
+                       image.cols, gradient_.ptr(y));
+    gradient_rows_[y] = 1;
+    return;
+}
+
+bool ViBe_plus::allowPropagation(const Mat& image, const uchar* top, const uchar* mask,
+                                 const uchar* bottom, int y, int x)
+{
+    // Ограничиваем пространственное распространение на границах объектов.
+    if ((y > 0 && y < image.rows - 1 && x > 0 && x < image.cols - 1) &&
+        (mask[x - 1] != BackGround || top[x] != BackGround ||
+        mask[x + 1] != BackGround || bottom[x] != BackGround))
+    {
+        // Плоскость градиента вычисляется по строкам при первом обращении.
+        if (gradient_rows_[y] == 0)
+            computeGradientRow(image, y);
+        if (gradient_.ptr(y)[x] != BackGround)
+            return false;
+    }
+
+    return true;
+}
@@ -14,6 +14,12 @@ using namespace cv;
 const uchar ForeGround = 255;
 const uchar Background = 0;
 
+// Количество кадров, в течение которых контуры у потерянной руки
+// анализируются в первую очередь.
+const int LostHandFrames = 15;
+// Добавка к оценке контура у потерянной руки, превышающая длину любого контура.
+const double LostHandPriority = 1e12;
+
 // Поиск точек экстремума и их индексов в векторе кривизны.
 static pair<vector<float>, vector<size_t>> findExtremums(const vector<float>& curvature)
 {
@@ -122,21 +128,21 @@ static bool checkFingersLength(const Finger fingers[5])
 }
 
 // Поиск координат точек контура с заданными индексами.
-static vector<Point2i> getContourPoints(const vector<Point2i>& contour, const vector<size_t>& point_indexes)
+static vector<Point2i> getContourPoints(const vector<Point2f>& contour, const vector<size_t>& point_indexes)
 {
     size_t size = point_indexes.size();
     vector<Point2i> points(size);
 
     for (size_t i = 0; i < size; ++i)
     {
-        points[i] = contour[point_indexes[i]];
+        points[i] = Point2i(cvRound(contour[point_indexes[i]].x), cvRound(contour[point_indexes[i]].y));
     }
 
     return points;
 }
 
 // Функция на основании анализа кривизны контура вычисляет, является ли контур рукой.
-static std::optional<Hand> handDetector(const vector<Point2i>& contour, const vector<float>& curvature)
+static std::optional<Hand> handDetector(const vector<Point2f>& contour, const vector<float>& curvature)
 {
     const size_t length = curvature.size();
     if (length < 2)
@@ -158,6 +164,14 @@ static std::optional<Hand> handDetector(const vector<Point2i>& contour, const ve
     return hand;
 }
 
+HandDetector::HandDetector()
+:hands_(), excluded_(), prev_pyr_(), contours_(), analysis_(), contour_points_(), smoother_(),
+curvature_engine_(), chord_lengths_(1, 75), filter_(), accepted_contours_(0), rejected_contours_(0), tile_size_(0), prev_image_(), prev_excluded_(),
+prev_contours_(), prev_analysis_(), changed_tiles_(), reused_contours_(0), budget_(), lost_hands_(),
+candidates_(), scores_(), budget_cuts_(0), skipped_contours_(0)
+{
+}
+
 void HandDetector::trace(InputArray BinaryImage)
 {
     Mat image = BinaryImage.getMat();
@@ -172,10 +186,12 @@ void HandDetector::trace(InputArray BinaryImage)
 
     for (auto hand = hands_.begin(); hand != hands_.end(); )
     {
+        const Rect box = hand->getBoundingBox();
         int status = hand->update(prev_pyr_, next_pyr);
         // Обработка пропадания руки.
         if (status == -1)
         {
+            lost_hands_.push_back({ box, 0 });
             auto to_remove = hand;
             ++hand;
             hands_.erase(to_remove);
@@ -189,63 +205,113 @@ void HandDetector::trace(InputArray BinaryImage)
     return;
 }
 
-// Сглаживание индексов в векторе.
-static void smoothVector(vector<float>& ticks, int nonzero)
+void HandDetector::detect(InputArray BinaryImage)
 {
-    dft(ticks, ticks);
-
-    nonzero = nonzero * 2;
-    for (size_t i = nonzero + 1; i < ticks.size(); ++i)
+    Mat image = BinaryImage.getMat();
+    updateExcluded();
+
+    // Извлечение контуров. Контуры и результаты обработки прошлого кадра
+    // остаются в prev_contours_ и prev_analysis_.
+    std::swap(contours_, prev_contours_);
+    std::swap(analysis_, prev_analysis_);
+    const bool incremental = (tile_size_ > 0) && (prev_image_.size() == image.size());
+    if (incremental)
     {
-        ticks[i] = 0;
+        findChangedTiles(prev_image_, prev_excluded_, image, excluded_, tile_size_, changed_tiles_);
+        extractContours(image, excluded_, prev_contours_, changed_tiles_, tile_size_, contours_);
+    }
+    else
+    {
+        extractContours(image, excluded_, contours_);
     }
 
-    dft (ticks, ticks, DFT_INVERSE + DFT_SCALE);
-    return;
-}
-
-// Сглаживание контура объекта.
-static void smoothContour(vector<Point2i>& contour, int nonzero)
-{
-    vector<float> ticks(contour.size());
-    for (size_t i = 0; i < contour.size(); ++i)
+    // Отбор контуров по характеристикам цепного кода.
+    analysis_.resize(contours_.size());
+    scores_.resize(contours_.size());
+    candidates_.clear();
+    for (size_t i = 0; i < contours_.size(); ++i)
     {
-        ticks[i] = contour[i].x;
+        const Contour contour = contours_[i];
+        ContourAnalysis& analysis = analysis_[i];
+        const int source = incremental ? contours_.getSource(i) : -1;
+        if (source >= 0)
+        {
+            std::swap(analysis, prev_analysis_[source]);
+            ++reused_contours_;
+        }
+        else
+        {
+            analysis.accepted = acceptContour(contour, analysis.box);
+            analysis.analysed = false;
+        }
+
+        if (!analysis.accepted)
+        {
+            ++rejected_contours_;
+            continue;
+        }
+
+        ++accepted_contours_;
+        candidates_.push_back((int)i);
+        scores_[i] = getScore(contour.size(), analysis.box);
     }
 
-    smoothVector(ticks, nonzero);
-    for (size_t i = 0; i < contour.size(); ++i)
+    // Анализ лучших контуров в пределах ограничения. Время отсчитывается
+    // от начала анализа, лучший контур анализируется всегда.
+    const size_t candidates_number = candidates_.size();
+    selectContours(scores_, budget_.max_contours, candidates_);
+    const int64 start_tick = getTickCount();
+    size_t analysed = 0;
+    for (; analysed < candidates_.size(); ++analysed)
     {
-        contour[i].x = ticks[i];
-        ticks[i] = contour[i].y;
+        const int64 time = (getTickCount() - start_tick) * 1000000 / (int64)getTickFrequency();
+        if ((budget_.max_time > 0) && (analysed > 0) && (time >= budget_.max_time))
+            break;
+
+        const Contour contour = contours_[candidates_[analysed]];
+        ContourAnalysis& analysis = analysis_[candidates_[analysed]];
+        if (!analysis.analysed)
+        {
+            contour.getContour(contour_points_);
+            // Оставляем только 5% низкочастотных дескрипторов
+            smoother_.apply(contour_points_, 0.05 * contour.size(), analysis.points);
+            curvature_engine_.apply(analysis.points, image.size(), chord_lengths_, analysis.curvature);
+            analysis.analysed = true;
+        }
+
+        // Распознавание руки по кривизне для каждой длины хорды по порядку.
+        for (const vector<float>& curvature : analysis.curvature)
+        {
+            optional<Hand> hand = handDetector(analysis.points, curvature);
+            if (hand)
+            {
+                hands_.push_back(*hand);
+                break;
+            }
+        }
     }
 
-    smoothVector(ticks, nonzero);
-    for (size_t i = 0; i < contour.size(); ++i)
+    if (analysed < candidates_number)
     {
-        contour[i].y = ticks[i];
+        ++budget_cuts_;
+        skipped_contours_ += candidates_number - analysed;
     }
 
-    return;
-}
+    for (auto hand = lost_hands_.begin(); hand != lost_hands_.end(); )
+    {
+        if (++hand->frames < LostHandFrames)
+        {
+            ++hand;
+            continue;
+        }
 
-void HandDetector::detect(InputArray BinaryImage)
-{
-    Mat image = BinaryImage.getMat();
-    updateMask(image.size());
+        hand = lost_hands_.erase(hand);
+    }
 
-    // Извлечение контуров.
-    vector<Contour> contours = extractContours(image, mask_);
-    for (size_t i = 0; i < contours.size(); ++i)
+    if (tile_size_ > 0)
     {
-        vector<Point2i> contour = contours[i].getContour();
-        // Оставляем только 5% низкочастотных дескрипторов
-        smoothContour(contour, 0.05 * contours[i].size());
-        vector<float> curvature = getCurvature(contour, image.size(), 75);
-        // Распознавание руки.
-        optional<Hand> hand = handDetector(contour, curvature);
-        if (hand)
-            hands_.push_back(*hand);
+        image.copyTo(prev_image_);
+        prev_excluded_ = excluded_;
     }
 
     return;
@@ -265,13 +331,120 @@ const list<Hand>& HandDetector::getHands() const
     return hands_;
 }
 
-void HandDetector::updateMask(Size size)
+void HandDetector::setContourFilter(const ContourFilter& filter)
 {
-    mask_.create(size, CV_8UC1);
-    mask_.setTo(ForeGround);
-    for (auto& hand : hands_)
+    filter_ = filter;
+    accepted_contours_ = 0;
+    rejected_contours_ = 0;
+    // Решения отбора прошлого кадра больше не действительны.
+    prev_image_.release();
+    return;
+}
+
+uint64 HandDetector::getAcceptedContours() const
+{
+    return accepted_contours_;
+}
+
+uint64 HandDetector::getRejectedContours() const
+{
+    return rejected_contours_;
+}
+
+void HandDetector::setIncremental(int tile_size)
+{
+    CV_Assert(tile_size >= 0);
+
+    tile_size_ = tile_size;
+    prev_image_.release();
+    reused_contours_ = 0;
+    return;
+}
+
+uint64 HandDetector::getReusedContours() const
+{
+    return reused_contours_;
+}
+
+void HandDetector::setDetectionBudget(const DetectionBudget& budget)
+{
+    budget_ = budget;
+    budget_cuts_ = 0;
+    skipped_contours_ = 0;
+    return;
+}
+
+uint64 HandDetector::getBudgetCuts() const
+{
+    return budget_cuts_;
+}
+
+uint64 HandDetector::getSkippedContours() const
+{
+    return skipped_contours_;
+}
+
+void HandDetector::setChordLengths(const vector<int>& chord_lengths)
+{
+    CV_Assert(!chord_lengths.empty());
+
+    chord_lengths_ = chord_lengths;
+    // Кривизна прошлого кадра вычислена для других хорд.
+    prev_image_.release();
+    return;
+}
+
+void HandDetector::setSpatialSmoothing(size_t min_points)
+{
+    smoother_.setSpatialThreshold(min_points);
+    // Точки прошлого кадра сглажены другим способом.
+    prev_image_.release();
+    return;
+}
+
+bool HandDetector::acceptContour(const Contour& contour, Rect& box) const
+{
+    // Длина известна без прохода по цепному коду.
+    const size_t points = contour.size();
+    if ((points < filter_.min_points) || ((filter_.max_points > 0) && (points > filter_.max_points)))
+        return false;
+
+    const ContourDescriptor descriptor = contour.getDescriptor();
+    const int min_side = std::min(descriptor.box.width, descriptor.box.height);
+    const int max_side = std::max(descriptor.box.width, descriptor.box.height);
+    if ((min_side < filter_.min_side) || ((filter_.max_side > 0) && (max_side > filter_.max_side)))
+        return false;
+
+    if ((descriptor.compactness < filter_.min_compactness) ||
+        ((filter_.max_compactness > 0) && (descriptor.compactness > filter_.max_compactness)))
+    {
+        return false;
+    }
+
+    box = descriptor.box;
+    return true;
+}
+
+double HandDetector::getScore(size_t points, const Rect& box) const
+{
+    // Длинные контуры подробнее описывают пальцы. Контуры, пересекающие
+    // место недавно потерянной руки, анализируются раньше всех остальных.
+    double score = (double)points;
+    for (const LostHand& hand : lost_hands_)
     {
-        Rect2i box = hand.getBoundingBox();
-        rectangle(mask_, box, Background, FILLED);
+        if ((hand.box & box).area() > 0)
+        {
+            score += LostHandPriority;
+            break;
+        }
     }
+
+    return score;
+}
+
+void HandDetector::updateExcluded()
+{
+    excluded_.clear();
+    for (auto& hand : hands_)
+        excluded_.push_back(hand.getBoundingBox());
 }
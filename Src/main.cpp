@@ -4,8 +4,10 @@
 #include <opencv2/video/video.hpp>
 
 #include <ViBe_plus.h>
+#include <BitMask.h>
 #include <CorrectionOfExposition.h>
 #include <HandDetector.h>
+#include <RunMask.h>
 #include <VideoSequenceCapture.h>
 #include <Timer.h>
 #include <Debug.h>
@@ -17,6 +19,9 @@ using namespace cv;
 const uchar ForeGround = 255;
 const uchar Background = 0;
 
+// Файл, в котором модель фона сохраняется между запусками программы.
+const char BackgroundModelFile[] = "Background.model";
+
 int main()
 {
     Timer total_timer, exposition_timer, motion_timer, detector_timer, tracker_timer, gestures_timer;
@@ -24,6 +29,7 @@ int main()
     //VideoSequenceCapture video("d:\\test_videos\\Input7\\0.png");
 
     ViBe_plus motion(20, 20, 2, 15);
+    motion.setParallelism(getNumThreads(), 0);
 
     namedWindow("Input");
     namedWindow("Background");
@@ -42,11 +48,19 @@ int main()
         waitKey(30);
     }
 
-    Mat bg_image(frame.size(), CV_8UC3);
+    // Продолжаем работу с модели фона, сохранённой при предыдущем запуске.
+    motion.load(BackgroundModelFile, frame.size());
+
     Mat fgmask(frame.size(), CV_8UC1);
+    // Упакованная маска для размыкания.
+    BitMask open_mask;
+    // Маска движущихся объектов после размыкания для коррекции яркости.
+    RunMask motion_mask;
     Mat tracker_image(frame.size(), CV_8UC3);
 
     HandDetector hand_detector;
+    // Контуры неподвижных объектов берутся с предыдущего кадра.
+    hand_detector.setIncremental(32);
     GesturesRecognition gestures_recognition;
 
     while (true)
@@ -60,13 +74,13 @@ int main()
         imageShow("Input", frame);
 
         // Коррекция яркости.
-        motion.getBackgroundImage(bg_image);
-        if (!bg_image.empty())
+        const Mat& bg_luma = motion.getBackgroundLuma();
+        if (!bg_luma.empty() && !motion_mask.empty())
         {
             exposition_timer.start();
-            correctionOfExposition(fgmask, bg_image, frame);
+            correctionOfExposition(motion_mask, bg_luma, motion.getBackgroundLumaSum(), frame);
             exposition_timer.stop();
-            imageShow("Background", bg_image);
+            imageShow("Background", motion.getBackground());
         }
 
         // Выделение движения.
@@ -76,13 +90,10 @@ int main()
         imageShow("Motion", fgmask);
 
         // Размыкание маски движущихся объектов.
-        const uchar kernel_values[25] = { 1, 1, 1, 1, 1,
-                                          1, 1, 1, 1, 1,
-                                          1, 1, 1, 1, 1,
-                                          1, 1, 1, 1, 1,
-                                          1, 1, 1, 1, 1 };
-        Matx <uchar, 5, 5> kernel_open(kernel_values);
-        morphologyEx(fgmask, fgmask, MORPH_OPEN, kernel_open);
+        open_mask.fromMat(fgmask);
+        open_mask.open(Size(5, 5));
+        open_mask.toMat(fgmask);
+        motion_mask.fromMat(fgmask);
         imageShow("Open", fgmask);
 
         tracker_timer.start();
@@ -108,6 +119,8 @@ int main()
             break;
     }
 
+    motion.save(BackgroundModelFile);
+
     frame.release();
     fgmask.release();
     destroyAllWindows();
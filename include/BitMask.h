@@ -0,0 +1,76 @@
+﻿/*
+    Бинарная маска, упакованная по одному биту на точку.
+*/
+
+#ifndef __BITMASK_H__
+#define __BITMASK_H__
+
+#include <vector>
+#include <opencv2/core.hpp>
+
+// Строки маски хранятся в 64-битных словах, младший бит слова k
+// соответствует точке x = 64 * k. Биты за пределами строки всегда нулевые.
+// Морфологические операции обрабатывают по 64 точки за операцию.
+class BitMask
+{
+public:
+    BitMask();
+    // Создаёт маску заданного размера, заполненную фоном.
+    explicit BitMask(const cv::Size& size);
+    // Упаковывает бинарное изображение, точки со значением 255
+    // относятся к переднему плану, остальные точки - к фону.
+    explicit BitMask(const cv::Mat& image);
+
+    // Пересоздаёт маску заданного размера, заполненную фоном.
+    void create(const cv::Size& size);
+    // Упаковывает бинарное изображение.
+    void fromMat(const cv::Mat& image);
+    // Распаковывает маску в бинарное изображение типа CV_8UC1.
+    void toMat(cv::Mat& image) const;
+
+    cv::Size size() const;
+    bool empty() const;
+    // Возвращает количество слов в строке.
+    int getWordsPerRow() const;
+    // Слова строки y.
+    const uint64* row(int y) const;
+    uint64* row(int y);
+
+    bool get(int y, int x) const;
+    void set(int y, int x, bool value);
+    // Возвращает количество точек переднего плана.
+    int countNonZero() const;
+
+    // Поточечные логические операции с маской того же размера.
+    BitMask& operator&=(const BitMask& other);
+    BitMask& operator|=(const BitMask& other);
+    BitMask& operator^=(const BitMask& other);
+
+    // Эрозия прямоугольным ядром с центральной точкой привязки.
+    // При border_foreground = true точки за границей маски считаются
+    // точками переднего плана, как в cv::erode по умолчанию.
+    void erode(const cv::Size& kernel, bool border_foreground = true);
+    // Дилатация прямоугольным ядром с центральной точкой привязки.
+    void dilate(const cv::Size& kernel);
+    // Эрозия крестообразным ядром 3x3, повторённая iterations раз.
+    void erodeCross(int iterations, bool border_foreground = true);
+    // Дилатация крестообразным ядром 3x3, повторённая iterations раз.
+    void dilateCross(int iterations);
+    // Размыкание прямоугольным ядром.
+    void open(const cv::Size& kernel);
+
+private:
+    cv::Size size_;
+    int words_; // Количество слов в строке.
+    std::vector<uint64> data_;
+
+    // Обнуляет биты за пределами строки.
+    void clearPadding(uint64* row) const;
+    // Морфологическая операция прямоугольным ядром: в строку записывается
+    // пересечение (erosion = true) или объединение сдвигов строк ядра.
+    void applyKernel(const cv::Size& kernel, bool erosion, bool border_foreground);
+    // Один шаг эрозии или дилатации крестообразным ядром.
+    void applyCross(bool erosion, bool border_foreground);
+};
+
+#endif // __BITMASK_H__
@@ -0,0 +1,70 @@
+﻿/*
+    Анализ связных областей бинарного изображения.
+*/
+
+#ifndef __COMPONENTANALYSIS_H__
+#define __COMPONENTANALYSIS_H__
+
+#include <utility>
+#include <vector>
+#include <opencv2/core.hpp>
+
+// Связная область бинарного изображения.
+struct Component
+{
+    bool foreground; // Область переднего плана или фона.
+    int area; // Площадь области в точках.
+    cv::Rect box; // Ограничивающий прямоугольник.
+    cv::Point start; // Первая точка области при построчном обходе, лежит на её внешней границе.
+};
+
+// Маркирует четырёхсвязные области переднего плана и фона за один проход
+// по изображению и собирает для них площади, ограничивающие прямоугольники
+// и начальные точки. Изображение делится на полосы строк, которые
+// маркируются параллельно, затем метки полос объединяются на их границах.
+class ComponentAnalysis
+{
+public:
+    ComponentAnalysis();
+
+    // Выделяет области на бинарном изображении. Точки со значением 255
+    // относятся к переднему плану, остальные точки - к фону.
+    void apply(const cv::Mat& image);
+
+    // Возвращает области в порядке построчного обхода их начальных точек.
+    const std::vector<Component>& getComponents() const;
+    // Возвращает пары соприкасающихся областей (передний план, фон)
+    // в виде номеров областей. Пары могут повторяться.
+    const std::vector<std::pair<int, int>>& getAdjacency() const;
+    // Записывает в каждую точку изображения значение values[i],
+    // где i - номер области, которой принадлежит точка.
+    void paint(const std::vector<uchar>& values, cv::Mat& image) const;
+
+private:
+    // Полоса строк, маркируемая независимо от остальных.
+    // Метки полосы локальные и начинаются с единицы.
+    struct Strip
+    {
+        int y_begin;
+        int y_end;
+        int offset; // Смещение меток полосы в общей таблице.
+        std::vector<int> parents;
+        std::vector<Component> stats;
+        std::vector<std::pair<int, int>> adjacency;
+        std::vector<int> opposite; // Метки другого цвета над текущей серией.
+    };
+
+    std::vector<Strip> strips_;
+    std::vector<int> parents_; // Общая таблица объединения меток.
+    std::vector<int> table_; // Номера областей для меток полос.
+    std::vector<Component> components_;
+    std::vector<std::pair<int, int>> adjacency_;
+    cv::Mat marked_; // Локальные метки полос.
+
+    // Маркирует области внутри полосы, соединяя серии точек соседних строк.
+    void markStrip(const cv::Mat& image, Strip& strip);
+    // Объединяет области, соприкасающиеся на границе двух соседних полос.
+    void mergeStrips(const cv::Mat& image, const Strip& top, const Strip& bottom);
+};
+
+#endif // __COMPONENTANALYSIS_H__
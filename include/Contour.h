@@ -7,34 +7,202 @@
 
 #include <opencv2/highgui.hpp>
 #include <opencv2/video/video.hpp>
+#include <iterator>
 #include <vector>
 
+#include <RunMask.h>
+
+class ContourStore;
+
+// Простые характеристики контура, вычисляемые по цепному коду.
+struct ContourDescriptor
+{
+    double perimeter; // Длина контура с учётом диагональных шагов.
+    double area; // Площадь многоугольника, обходимого контуром.
+    double compactness; // Отношение 4 * pi * area / perimeter^2, у круга близко к 1.
+    cv::Rect box; // Ограничивающий прямоугольник.
+};
+
+// Контур, цепной код которого хранится в ContourStore. Объект не владеет
+// данными и действителен до очистки хранилища, точки контура
+// восстанавливаются из цепного кода при обходе.
 class Contour
 {
 public:
-    // Реализация алгоритма прослеживания границы.
-    Contour(const cv::Mat& image, const cv::Point2i& point);
+    // Итератор по точкам контура.
+    class Iterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = cv::Point2i;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const cv::Point2i*;
+        using reference = const cv::Point2i&;
+
+        Iterator(const ContourStore* store, const cv::Point2i& point, size_t code, size_t end_code, size_t index);
+
+        reference operator*() const { return point_; }
+        pointer operator->() const { return &point_; }
+        Iterator& operator++();
+        Iterator operator++(int);
+        bool operator==(const Iterator& other) const { return index_ == other.index_; }
+        bool operator!=(const Iterator& other) const { return index_ != other.index_; }
+
+    private:
+        const ContourStore* store_;
+        cv::Point2i point_; // Текущая точка.
+        size_t code_; // Номер кода, ведущего к следующей точке.
+        size_t end_code_; // Номер кода после последнего кода контура.
+        size_t index_; // Номер текущей точки.
+    };
+
+    Contour(const ContourStore* store, const cv::Point2i& start, size_t offset, size_t length);
 
     size_t size() const;
-    // Возвращает вектор точек контура.
-    std::vector<cv::Point2i> getContour() const;
+    // Возвращает начальную точку контура.
+    cv::Point2i getStart() const;
+    // Возвращает код направления от точки i к точке i + 1.
+    int getCode(size_t i) const;
+    Iterator begin() const;
+    Iterator end() const;
+    // Записывает точки контура в вектор, не уменьшая его ёмкость.
+    void getContour(std::vector<cv::Point2i>& points) const;
+    // Вычисляет характеристики контура за один проход по цепному коду
+    // без восстановления точек в память.
+    ContourDescriptor getDescriptor() const;
     // Функция рисует контур на заданном изображении.
     void printContour(cv::Mat& image, uchar label) const;
 
 private:
+    const ContourStore* store_;
     // Начало контура.
     cv::Point2i start_;
-    // Вектор для хранения цепного кода.
-    std::vector<int> chain_code_;
+    // Номер первого кода контура в хранилище.
+    size_t offset_;
+    // Количество кодов контура.
+    size_t length_;
+};
+
+// Хранилище контуров кадра. Цепные коды всех контуров записываются подряд
+// в общий буфер по 3 бита на код. Очистка хранилища сохраняет выделенную
+// память, поэтому после первых кадров новые контуры не выделяют память.
+class ContourStore
+{
+public:
+    ContourStore();
+
+    // Удаляет все контуры, сохраняя выделенную память.
+    void clear();
+    size_t size() const;
+    bool empty() const;
+    Contour operator[](size_t i) const;
+
+    // Находит все внешние границы объектов и границы дырок в них
+    // на бинарном изображении. Точки прямоугольников excluded считаются
+    // точками фона. Контуры короче min_size точек не сохраняются.
+    // Изображение обрабатывается горизонтальными полосами параллельно,
+    // порядок контуров совпадает с порядком построчного обхода.
+    void extract(const cv::Mat& image, const std::vector<cv::Rect>& excluded, size_t min_size);
+    // Инкрементальный поиск границ. changed - карта изменившихся с прошлого
+    // кадра блоков размером tile_size x tile_size. Граница, найденная в previous,
+    // окрестность ограничивающего прямоугольника которой не задевает изменившиеся
+    // блоки, не прослеживается заново, а копируется из previous.
+    void extract(const cv::Mat& image, const std::vector<cv::Rect>& excluded, size_t min_size,
+                 const ContourStore& previous, const cv::Mat& changed, int tile_size);
+    // Номер контура i в хранилище previous, из которого он скопирован,
+    // или -1, если контур прослежен заново.
+    int getSource(size_t i) const;
+
+    // Возвращает код с номером index общего буфера.
+    int getCode(size_t index) const;
+
+private:
+    // Описание контура в общем буфере.
+    struct Record
+    {
+        cv::Point2i start;
+        size_t offset;
+        size_t length;
+        cv::Rect box; // Ограничивающий прямоугольник.
+        bool hole; // Граница дырки.
+        int source; // Номер контура в предыдущем хранилище или -1.
+    };
+
+    // Полоса строк изображения, обрабатываемая в отдельном потоке.
+    struct Stripe
+    {
+        int y_begin;
+        int y_end;
+        std::vector<Run> runs; // Серии строк полосы.
+        std::vector<int> counts; // Количество серий в каждой строке.
+        std::vector<Record> records; // Границы, начинающиеся в полосе.
+        std::vector<uchar> codes; // Цепные коды этих границ.
+    };
+
+    std::vector<Record> records_;
+    std::vector<uint64> codes_; // Цепные коды по 21 коду на слово.
+    size_t codes_number_; // Количество записанных кодов.
+
+    // Буферы поиска границ. Узлы системы непересекающихся множеств -
+    // серии объектов и промежутки фона между ними (по одному перед
+    // каждой серией строки и после последней), пронумерованные в порядке
+    // построчного обхода. Корень каждой области - её первый узел.
+    std::vector<Stripe> stripes_;
+    std::vector<Run> runs_; // Серии всех строк подряд.
+    std::vector<int> rows_; // Индексы первых серий строк.
+    std::vector<int> parents_; // Родители узлов.
+    std::vector<uchar> frame_; // Промежуток фона связан с краем изображения.
+    const std::vector<cv::Rect>* excluded_; // Исключённые прямоугольники.
+    cv::Mat image_; // Обрабатываемое изображение.
+
+    // Данные инкрементального поиска.
+    const ContourStore* previous_; // Хранилище предыдущего кадра.
+    std::vector<int> previous_order_; // Контуры previous_ в порядке начальных точек.
+    cv::Mat changed_; // Карта изменившихся блоков.
+    int tile_size_;
+
+    // Добавляет код в конец общего буфера.
+    void pushCode(int code);
+    // Находит границы, используя предыдущее хранилище, если оно задано.
+    void findBorders(const cv::Mat& image, const std::vector<cv::Rect>& excluded, size_t min_size);
+    // Разбивает строки полосы на серии точек объектов.
+    void buildRuns(Stripe& stripe) const;
+    // Добавляет серию [begin, end) строки y без точек исключённых прямоугольников.
+    void addRun(int y, int begin, int end, std::vector<Run>& runs) const;
+    // Возвращает промежуток фона k строки y и его номер узла.
+    Run getGap(int y, int k) const;
+    int getGapNode(int y, int k) const;
+    // Объединяет области серий и промежутков строк y - 1 и y.
+    void linkRows(int y);
+    // Находит начальные точки границ полосы и прослеживает границы.
+    void traceStripe(Stripe& stripe) const;
+    // Ищет в предыдущем хранилище неизменившуюся границу с заданным началом,
+    // возвращает её номер или -1.
+    int findPrevious(const cv::Point2i& start, bool hole) const;
+    // Проверяет, что точка лежит на изображении и относится к объекту.
+    bool isObject(const cv::Point2i& point) const;
+    // Прослеживает границу от точки start и записывает её в полосу,
+    // direction - направление на соседнюю точку фона, с которой
+    // начинается обход.
+    void traceBorder(const cv::Point2i& start, int direction, Stripe& stripe) const;
 };
 
-// Поиск контуров на изображении.
-std::vector<Contour> extractContours(cv::InputArray BinImage, cv::InputArray Mask);
+// Поиск контуров на изображении вне прямоугольников excluded.
+void extractContours(cv::InputArray BinImage, const std::vector<cv::Rect>& excluded, ContourStore& contours);
+// Инкрементальный поиск контуров, неизменившиеся контуры копируются из previous.
+void extractContours(cv::InputArray BinImage, const std::vector<cv::Rect>& excluded, const ContourStore& previous,
+                     const cv::Mat& changed, int tile_size, ContourStore& contours);
+// Функция строит карту блоков размером tile_size x tile_size, в которых
+// изображения различаются или которые задевают прямоугольники, исключённые
+// только на одном из кадров.
+void findChangedTiles(const cv::Mat& previous, const std::vector<cv::Rect>& previous_excluded,
+                      const cv::Mat& image, const std::vector<cv::Rect>& excluded,
+                      int tile_size, cv::Mat& changed);
 // Функция рисует все контуры на изображении.
-void printContours(cv::Mat& image, const std::vector<Contour>& contours);
-// Функция упорядочивает контуры по убыванию длины.
-void sortContours(std::vector<Contour>& contours);
-// Функция вычисляет кривизну контура в каждой точке.
-std::vector<float> getCurvature(const std::vector<cv::Point2i>& contour, const cv::Size& image_size, const int chord_length);
+void printContours(cv::Mat& image, const ContourStore& contours);
+// Функция оставляет в indexes номера не более count контуров с наибольшими
+// оценками scores и упорядочивает их по убыванию оценки, count = 0 - без
+// ограничения. Упорядочиваются только оставшиеся контуры.
+void selectContours(const std::vector<double>& scores, size_t count, std::vector<int>& indexes);
 
 #endif // __CONTOUR_H__
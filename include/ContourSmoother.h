@@ -0,0 +1,37 @@
+﻿/*
+    Сглаживание контура низкочастотной фильтрацией.
+*/
+
+#ifndef __CONTOURSMOOTHER_H__
+#define __CONTOURSMOOTHER_H__
+
+#include <vector>
+#include <opencv2/core.hpp>
+
+// Сглаживание замкнутого контура, точки которого рассматриваются как один
+// комплексный сигнал x + iy. По умолчанию в спектре контура остаются только
+// гармоники с номерами не больше заданного. Длина сигнала приводится к
+// быстрому для ДПФ размеру периодической линейной интерполяцией. Буфер
+// сигнала общий для всех контуров и растёт до наибольшего размера ДПФ.
+class ContourSmoother
+{
+public:
+    ContourSmoother();
+
+    // Контуры из spatial_threshold и более точек сглаживаются за O(n)
+    // двукратным скользящим средним с окном, согласованным с числом
+    // гармоник. 0 - всегда использовать ДПФ.
+    void setSpatialThreshold(size_t spatial_threshold);
+    // Сглаживает контур, оставляя гармоники с номерами не больше harmonics.
+    void apply(const std::vector<cv::Point2i>& contour, int harmonics, std::vector<cv::Point2f>& smoothed);
+
+private:
+    void smoothFourier(const std::vector<cv::Point2i>& contour, int harmonics, std::vector<cv::Point2f>& smoothed);
+    void smoothSpatial(const std::vector<cv::Point2i>& contour, int harmonics, std::vector<cv::Point2f>& smoothed);
+
+    cv::Mat signal_; // Комплексный сигнал и его спектр в первых точках строки.
+    std::vector<cv::Point2f> buffer_; // Промежуточный результат скользящего среднего.
+    size_t spatial_threshold_;
+};
+
+#endif // __CONTOURSMOOTHER_H__
@@ -4,16 +4,21 @@
 
 #include <opencv2/highgui.hpp>
 
+#include <RunMask.h>
+
 /*
     Функция подстраивает яркость текущего кадра под яркость фонового изображения.
 
     Входные параметры:
-    SegmentationMask - бинарное изображение с отмеченными движущимися объектами
-                       с предыдущего кадра.
-    BackgroundImage  - цветное изображение текущего фона.
-    CurrentImage     - текущий кадр в формате Y, яркость которого будет
-                       изменена в соответствии с фоновым изображением.
+    SegmentationMask  - маска с отмеченными движущимися объектами
+                        с предыдущего кадра.
+    BackgroundLuma    - яркость Y изображения текущего фона
+                        (размеры маски и фона должны совпадать с размером кадра).
+    BackgroundLumaSum - сумма яркостей всех точек BackgroundLuma.
+    CurrentImage      - текущий кадр в формате Y, яркость которого будет
+                        изменена в соответствии с фоновым изображением.
 */
-void correctionOfExposition(const cv::Mat& segmentationMask,
-                            const cv::Mat& backgroundImage,
+void correctionOfExposition(const RunMask& segmentationMask,
+                            const cv::Mat& backgroundLuma,
+                            int64 backgroundLumaSum,
                             cv::Mat& currentImage);
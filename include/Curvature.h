@@ -0,0 +1,52 @@
+﻿/*
+    Вычисление кривизны контура по расстояниям от точек до хорд.
+*/
+
+#ifndef __CURVATURE_H__
+#define __CURVATURE_H__
+
+#include <vector>
+#include <opencv2/core.hpp>
+
+// Вычислитель кривизны, сохраняющий буферы между контурами.
+// Кривизна в точке - наибольшее расстояние от неё до хорд длины
+// chord_length, проходящих над точкой. Хорды, конец которой ближе
+// 10 точек к краю изображения, не учитываются.
+class CurvatureEngine
+{
+public:
+    CurvatureEngine();
+
+    // Вычисляет кривизну контура в каждой точке.
+    void apply(const std::vector<cv::Point2f>& contour, const cv::Size& image_size, int chord_length,
+               std::vector<float>& curvature);
+    // Вычисляет кривизну для нескольких длин хорд за один проход по точкам
+    // контура: curvatures[k] - кривизна для хорд длины chord_lengths[k].
+    // Отметки точек у края изображения и координаты точки вычисляются
+    // один раз для всех длин.
+    void apply(const std::vector<cv::Point2f>& contour, const cv::Size& image_size,
+               const std::vector<int>& chord_lengths, std::vector<std::vector<float>>& curvatures);
+
+private:
+    // Кривизна в точке i для хорд длины chord_length, a, b, c -
+    // коэффициенты прямых хорд этой длины.
+    float getPointCurvature(const std::vector<cv::Point2f>& contour, int i, int chord_length,
+                            const float* a, const float* b, const float* c) const;
+
+    // Точка лежит ближе 10 точек к краю изображения.
+    std::vector<uchar> near_border_;
+    // Прямые хорд от точки j до точки j + chord_length - 1 в виде
+    // a * x + b * y + c = 0 с единичным вектором (a, b). У отброшенных
+    // хорд все коэффициенты равны 0.
+    // Коэффициенты хранятся подряд для всех длин хорд, offsets_[k] - начало
+    // прямых хорд длины с номером k.
+    std::vector<float> a_;
+    std::vector<float> b_;
+    std::vector<float> c_;
+    std::vector<size_t> offsets_;
+    // Буферы вычисления для одной длины хорды.
+    std::vector<int> chord_lengths_;
+    std::vector<std::vector<float>> curvatures_;
+};
+
+#endif // __CURVATURE_H__
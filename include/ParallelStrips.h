@@ -0,0 +1,15 @@
+﻿/*
+    Разбиение изображения на горизонтальные полосы для параллельной обработки.
+*/
+
+#ifndef __PARALLEL_STRIPS_H__
+#define __PARALLEL_STRIPS_H__
+
+// Минимальная высота полосы, обрабатываемой в отдельном потоке.
+const int MinStripHeight = 16;
+
+// Возвращает количество полос для изображения из rows строк: не больше
+// количества потоков и не больше, чем помещается полос высотой MinStripHeight.
+int getStripsNumber(int rows);
+
+#endif // __PARALLEL_STRIPS_H__
@@ -0,0 +1,53 @@
+﻿/*
+    Бинарная маска, закодированная сериями точек переднего плана.
+*/
+
+#ifndef __RUNMASK_H__
+#define __RUNMASK_H__
+
+#include <vector>
+#include <opencv2/core.hpp>
+
+// Серия точек переднего плана [begin, end) в строке маски.
+struct Run
+{
+    int begin;
+    int end;
+};
+
+// Маска хранит для каждой строки упорядоченный список непересекающихся
+// и несоприкасающихся серий точек переднего плана. Время всех операций
+// зависит от количества серий, а не от количества точек маски.
+class RunMask
+{
+public:
+    RunMask();
+    // Кодирует бинарное изображение, точки со значением 255 относятся
+    // к переднему плану, остальные точки - к фону.
+    explicit RunMask(const cv::Mat& image);
+
+    // Кодирует бинарное изображение.
+    void fromMat(const cv::Mat& image);
+    // Записывает маску в бинарное изображение типа CV_8UC1.
+    void toMat(cv::Mat& image) const;
+
+    cv::Size size() const;
+    bool empty() const;
+    // Серии строки y: [rowBegin(y), rowEnd(y)).
+    const Run* rowBegin(int y) const;
+    const Run* rowEnd(int y) const;
+
+    // Дилатация крестообразным ядром 3x3, повторённая iterations раз.
+    void dilateCross(int iterations);
+
+private:
+    cv::Size size_;
+    std::vector<Run> runs_; // Серии всех строк подряд.
+    std::vector<int> rows_; // Индексы первых серий строк, size_.height + 1 элемент.
+
+    // Заменяет строки маски результатом построчной операции над сериями.
+    template <typename RowOperation>
+    void transformRows(RowOperation operation);
+};
+
+#endif // __RUNMASK_H__
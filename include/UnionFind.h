@@ -0,0 +1,18 @@
+﻿/*
+    Объединение непересекающихся множеств в таблице родителей.
+*/
+
+#ifndef __UNION_FIND_H__
+#define __UNION_FIND_H__
+
+#include <vector>
+
+// Возвращает корень множества элемента label. Каждый пройденный элемент
+// перевешивается на своего деда, поэтому цепочки родителей не накапливаются.
+int findRoot(int label, std::vector<int>& parents);
+
+// Объединяет множества элементов first и second и возвращает корень
+// объединения. Меньший корень становится родителем большего.
+int mergeSets(int first, int second, std::vector<int>& parents);
+
+#endif // __UNION_FIND_H__
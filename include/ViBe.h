@@ -5,49 +5,172 @@
 #ifndef __VIBE_H__
 #define __VIBE_H__
 
+#include <functional>
+#include <string>
+#include <vector>
 #include <opencv2/core.hpp>
 #include <opencv2/video.hpp>
 
+// Представление значений пикселей в модели фона.
+enum class ViBeModel
+{
+    Color,  // Цвет BGR, 3 байта на значение.
+    Luma,   // Яркость Y, 1 байт на значение.
+    Compact // Яркость Y и цветность Cr, Cb, квантованная до 4 бит, 2 байта на значение.
+};
+
 class ViBe : public cv::BackgroundSubtractor
 {
 public:
     ViBe();
-    ViBe(int history_depth, int radius, int min_overlap, int probability);
-    ~ViBe();
+    ViBe(int history_depth, int radius, int min_overlap, int probability,
+         ViBeModel model = ViBeModel::Color);
 
     // Функция вычисляет маску сегментации и обновляет модель.
     // TODO: вычислять prob через learningrate.
     void apply(const cv::InputArray &image, cv::OutputArray &mask, double);
     // Функция вычисляет изображение фона.
     void getBackgroundImage(cv::OutputArray& backgroundImage) const;
+    // Изображение фона без копирования. Данные меняются при обновлении модели.
+    // Размер совпадает с размером модели, который у ViBe_plus с уменьшением
+    // кадра меньше размера кадра.
+    const cv::Mat& getBackground() const;
+    // Яркость Y изображения фона, обновляемая вместе с ним. Размер тот же,
+    // что у getBackground.
+    const cv::Mat& getBackgroundLuma() const;
+    // Сумма яркостей всех точек изображения фона, поддерживаемая при обновлении.
+    int64 getBackgroundLumaSum() const;
+    // Возвращает объём памяти, занимаемый значениями модели, в байтах.
+    size_t getModelMemory() const;
+    // Кадр обрабатывается параллельно bands_number полосами строк. Каждая полоса
+    // использует свой генератор случайных чисел, состояние которого выводится из seed,
+    // поэтому при фиксированных seed и bands_number результат воспроизводим.
+    void setParallelism(int bands_number, uint64 seed);
+    // Включает пропуск неизменившихся блоков размером tile_size x tile_size.
+    // Блок классифицируется заново, только если в нём был передний план или значение
+    // какой-либо компоненты его точки отличается от значения при последней классификации
+    // блока больше чем на threshold. Точки остальных блоков относятся к фону, модель в них
+    // обновляется как обычно. tile_size = 0 отключает пропуск.
+    void setActivityGate(int tile_size, int threshold);
+    // Доля пропущенных блоков с момента включения пропуска.
+    double getSkippedTileFraction() const;
+    // Сохранение полного состояния модели (параметры, значения модели, фон,
+    // состояния генераторов) в файл. Возвращает false при ошибке записи.
+    bool save(const std::string& filename) const;
+    // Загрузка состояния, сохранённого функцией save. Параметры алгоритма и количество
+    // полос берутся из файла. Если frame_size задан и отличается от размера сохранённой
+    // модели, модель пересчитывается к frame_size; иначе модель другого размера будет
+    // заново инициализирована первым кадром. Возвращает false, если файл не прочитан
+    // или имеет неподдерживаемый формат, в этом случае модель не меняется.
+    bool load(const std::string& filename, const cv::Size& frame_size = cv::Size());
 
 protected:
+    // Состояние процесса обновления модели в полосе строк.
+    struct UpdateStream
+    {
+        cv::RNG generator; // Генератор случайных чисел полосы.
+        unsigned position; // Текущая позиция в таблицах случайных чисел.
+        int pixel_skip; // Количество точек до следующего обновления модели самой точки.
+        int neibor_skip; // Количество точек до следующего обновления модели соседа.
+        int64 luma_delta; // Изменение суммы яркостей фона при обновлении полосы.
+    };
+
     // Возвращаемое значение равно true, если необходима инициализация
     // модели фона, и false, иначе.
     bool needToInit();
     // Функция инизиализации модели.
     void initialize(const cv::Mat &);
-    // Функция классификации точек изображения.
+    // Функция классификации точек изображения. Кадр, переведённый в представление
+    // модели, сохраняется и используется при последующем обновлении модели.
     void getSegmentationMask(const cv::Mat &image, cv::Mat &segmentation_mask);
-    // Обновление модели фона в заданной точке.
-    void updatePixel(const cv::Mat& image, int y, int x);
-    // Обновление модели фона случайного соседа из восьмисвязной области заданной точки.
-    void updateNeiborPixel(const cv::Mat& image, int y, int x);
+    // Классификация точек [x_begin, x_end) строки y с векторизацией, если она доступна.
+    // src - строка кадра в представлении модели.
+    void segmentRow(const uchar* src, int y, int x_begin, int x_end, uchar* dst);
+    // Эталонная скалярная классификация точек [x_begin, x_end) строки y.
+    void segmentRowScalar(const uchar* src, int y, int x_begin, int x_end, uchar* dst);
+    // Классификация значения value в представлении модели по модели точки (y, x).
+    uchar segmentValue(const uchar* value, int y, int x);
+    // Перевод кадра BGR в представление модели. Для полноцветной модели
+    // converted ссылается на данные image.
+    void convertFrame(const cv::Mat& image, cv::Mat& converted) const;
+    // Размер модели для кадров размера frame_size.
+    virtual cv::Size getModelSize(const cv::Size& frame_size) const;
+    // Функция обновления модели алгоритма в точках фона маски update_mask.
+    void update(const cv::Mat &image, const cv::Mat &update_mask);
+    // Обновление модели в точках фона строки y маски обновления mask. top и bottom -
+    // соседние строки маски, nullptr для первой и последней строк кадра. Строки одной
+    // полосы должны обновляться по порядку между вызовами beginUpdate и finishUpdate.
+    void updateRow(const cv::Mat& image, const uchar* top, const uchar* mask, const uchar* bottom,
+                   int y, UpdateStream& stream);
+    // Подготовка обновления модели по кадру image.
+    virtual void beginUpdate(const cv::Mat& image);
+    // Завершение обновления модели: перенос изменений полос в сумму яркостей фона.
+    void finishUpdate();
+    // Вызывается после успешной загрузки модели функцией load.
+    virtual void finishLoad(const cv::Size& frame_size);
+    // Возвращает true, если точка фона (y, x) может обновить модель соседа.
+    // top, mask, bottom - строки y - 1, y, y + 1 маски обновления.
+    virtual bool allowPropagation(const cv::Mat& image, const uchar* top, const uchar* mask,
+                                  const uchar* bottom, int y, int x);
+    // Запись значения точки в случайное значение её модели и в изображение фона.
+    void updatePixel(const cv::Mat& image, int y, int x, UpdateStream& stream);
+    // Запись значения точки в модель случайного соседа из восьмисвязной области.
+    void updateNeiborPixel(const cv::Mat& image, int y, int x, UpdateStream& stream);
+    // Вызывает body(stream, y_begin, y_end) для каждой полосы строк в пуле потоков.
+    // При separate_neighbors = true чётные и нечётные полосы обрабатываются в разных
+    // проходах, поэтому запись в соседей граничных строк не пересекается между потоками.
+    void processBands(const std::function<void(UpdateStream&, int, int)>& body, bool separate_neighbors);
 
 private:
     int history_depth_; // Количество хранимых значений для каждого пикселя.
     int sqr_rad_; // Квадрат максимального расстояния для включения точки в модель.
     int min_overlap_; // Минимальное количество совпадений значения пикселя с моделью.
     int probability_; // Вероятность обновления модели.
+    ViBeModel model_; // Представление значений модели.
+    int channels_; // Количество байт на одно значение модели.
     bool initialized_; // Флаг инициализации модели.
-    cv::Mat_<cv::Point3_<uchar>*> samples_; // Матрица для хранения значений пикселей.
+    // Значения пикселей модели: history_depth_ плоскостей размером (rows + 2) x (cols + 2),
+    // лежащих друг за другом в одном непрерывном буфере. Рамка шириной в один пиксель
+    // позволяет обращаться к соседям граничных точек без проверок.
+    cv::Mat samples_;
+    cv::Size size_; // Размер изображения, для которого построена модель.
+    cv::Mat frame_; // Текущий кадр в представлении модели.
     cv::Mat bg_mat_; // Матрица для хранения фона.
-    cv::RNG generator_; // Генератор случайных чисел (используется равномерный закон распределения).
+    cv::Mat bg_luma_; // Яркость изображения фона.
+    int64 bg_luma_sum_; // Сумма яркостей изображения фона.
+    std::vector<UpdateStream> streams_; // Состояния обновления полос строк.
+    // Таблицы случайных чисел, общие для всех полос.
+    std::vector<ushort> sample_table_; // Индексы обновляемых значений модели.
+    std::vector<uchar> neibor_table_; // Индексы соседей из восьмисвязной области.
+    std::vector<ushort> skip_table_; // Количество точек до следующей обновляемой точки.
+    // Карта активности блоков.
+    int tile_size_; // Размер блока, 0 - пропуск блоков отключён.
+    int tile_threshold_; // Порог изменения значения точки блока.
+    cv::Mat tiles_; // Состояния блоков.
+    cv::Mat reference_; // Значения точек на кадре последней классификации блока.
+    uint64 tiles_total_; // Количество проверенных блоков.
+    uint64 tiles_skipped_; // Количество пропущенных блоков.
 
+    // Возвращает указатель на k-е значение модели в точке (y, x).
+    // Координаты могут указывать на рамку: -1 <= y <= rows, -1 <= x <= cols.
+    uchar* getSample(int k, int y, int x);
     // Функция выдаёт случайную точку из восьмисвязной области.
-    cv::Point2i getRandomNeiborPixel(const cv::Point2i &);
-    // Функция обновления модели алгоритма.
-    void update(const cv::Mat &image, const cv::Mat &update_mask);
+    // Для граничных точек сосед может оказаться на рамке модели.
+    cv::Point2i getRandomNeiborPixel(const cv::Point2i &, cv::RNG& generator);
+    // Заполнение таблиц случайных чисел.
+    void buildRandomTables(cv::RNG& generator);
+    // Классификация точек только в блоках, изменившихся с последней классификации.
+    void segmentActiveTiles(const cv::Mat& image, cv::Mat& segmentation_mask);
+    // Количество полос строк для текущего размера модели.
+    int getBandsNumber() const;
+    // Вычисление яркости изображения фона и её суммы.
+    void computeBackgroundLuma();
+    // Пересчёт загруженной модели к размеру кадра frame_size.
+    void resample(const cv::Size& frame_size);
+    // Выбор случайных начальных расстояний до обновляемых точек полосы.
+    void resetStream(UpdateStream& stream);
+    // Возвращает количество точек, пропускаемых до следующей обновляемой точки.
+    int getNextSkip(UpdateStream& stream);
 
     // Копирование запрещено
     void operator=(const ViBe &) = delete;
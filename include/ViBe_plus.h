@@ -5,23 +5,65 @@
 #ifndef __VIBE_PLUS_H__
 #define __VIBE_PLUS_H__
 
+#include <vector>
 #include <opencv2/core.hpp>
 #include <opencv2/video.hpp>
 
 #include <ViBe.h>
+#include <ComponentAnalysis.h>
 
 class ViBe_plus : public ViBe
 {
 public:
     ViBe_plus();
-    ViBe_plus(int history_depth, int radius, int min_overlap, int probability);
+    // При scale > 1 модель строится для кадра, уменьшенного в scale раз. Точки
+    // полноразмерного кадра классифицируются заново только вблизи границ
+    // уменьшенной маски, по модели соответствующей точки уменьшенного кадра.
+    ViBe_plus(int history_depth, int radius, int min_overlap, int probability,
+              ViBeModel model = ViBeModel::Color, int scale = 1);
 
     // Функция вычисляет маску сегментации и обновляет модель.
     // TODO: вычислять prob через learningrate.
     void apply(const cv::InputArray &image, cv::OutputArray &mask, double);
+    // Функция вычисляет изображение фона размером с входной кадр.
+    void getBackgroundImage(cv::OutputArray& backgroundImage) const override;
+
+protected:
+    // Запрещает обновление модели соседей в точках с большим градиентом на границах объектов.
+    bool allowPropagation(const cv::Mat& image, const uchar* top, const uchar* mask,
+                          const uchar* bottom, int y, int x) override;
+    // Подготовка плоскости градиента для кадра image.
+    void beginUpdate(const cv::Mat& image) override;
+    // Запоминает размер кадра, для которого загружена модель.
+    void finishLoad(const cv::Size& frame_size) override;
+    // Размер кадра, уменьшенного в scale_ раз.
+    cv::Size getModelSize(const cv::Size& frame_size) const override;
 
 private:
-    void update(const cv::Mat& image, const cv::Mat& update_mask);
+    int scale_; // Коэффициент уменьшения кадра перед сегментацией.
+    cv::Size frame_size_; // Размер входного кадра.
+    cv::Mat small_image_; // Уменьшенный кадр.
+    cv::Mat small_mask_; // Маска сегментации уменьшенного кадра.
+    cv::Mat border_; // Точки уменьшенной маски, соседи которых классифицированы иначе.
+    cv::Mat full_frame_; // Полноразмерный кадр в представлении модели.
+    ComponentAnalysis components_; // Разметка областей маски сегментации.
+    std::vector<uchar> values_; // Значения областей маски после удаления шума.
+    cv::Mat update_mask_; // Маска обновления модели.
+    // Точки текущего кадра с большим градиентом, строки вычисляются при первом обращении.
+    cv::Mat gradient_;
+    std::vector<uchar> gradient_rows_; // Флаги вычисленных строк gradient_.
+    cv::Mat grey_; // Строки текущего кадра в градациях серого, вычисляются при первом обращении.
+    std::vector<uchar> grey_rows_; // Флаги вычисленных строк grey_.
+
+    // Удаление шума из маски сегментации и обновление модели по маске
+    // обновления с заполненными дырами по общей разметке областей.
+    void filterAndUpdate(const cv::Mat& image, cv::Mat& mask);
+
+    // Вычисление строки y плоскости градиента.
+    void computeGradientRow(const cv::Mat& image, int y);
+    // Перенос уменьшенной маски на полноразмерную с повторной классификацией
+    // точек полноразмерного кадра вблизи границ объектов.
+    void refineMask(const cv::Mat& image, cv::Mat& mask);
 };
 
 #endif // __VIBE_PLUS_H__
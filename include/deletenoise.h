@@ -5,10 +5,19 @@
 #ifndef __DELETENOISE_H__
 #define __DELETENOISE_H__
 
+#include <vector>
 #include <opencv2/core.hpp>
 
+#include <ComponentAnalysis.h>
+
 // Функция удаляет объекты, меньшие по площади, чем min_fg_area
 // и "дырки" в объектах, меньшие по площади, чем min_bg_area.
 void deleteNoise(cv::Mat &image, int min_fg_area, int min_bg_area);
 
+// Записывает в values[i] значение точек области i изображения, размеченного
+// analysis, после удаления шума с теми же порогами, что у deleteNoise.
+// Позволяет получить по одной разметке несколько масок с разными порогами.
+void classifyComponents(const ComponentAnalysis& analysis, int min_fg_area, int min_bg_area,
+                        std::vector<uchar>& values);
+
 #endif // __DELETENOISE_H__
@@ -9,11 +9,43 @@
 #include <list>
 #include <opencv2/core.hpp>
 
+#include <Contour.h>
+#include <ContourSmoother.h>
+#include <Curvature.h>
 #include <Hand.h>
 
+// Параметры отбора контуров перед сглаживанием и анализом кривизны.
+// Нулевое значение отключает соответствующее ограничение.
+struct ContourFilter
+{
+    // Среди максимумов кривизны ищутся 9, разнесённых не менее чем
+    // на 50 точек, поэтому более короткие контуры рукой не являются.
+    size_t min_points = 400;
+    size_t max_points = 0;
+    // Ограничения на стороны ограничивающего прямоугольника.
+    int min_side = 0;
+    int max_side = 0;
+    // Ограничения компактности: вытянутые границы вроде краёв двери
+    // имеют компактность около 0, сплошные пятна - около 1. Пороги
+    // зависят от сцены и по умолчанию отключены.
+    double min_compactness = 0;
+    double max_compactness = 0;
+};
+
+// Ограничение работы детектора на один кадр. Нулевое значение
+// отключает соответствующее ограничение. Контур с наибольшей оценкой
+// анализируется при любом ограничении времени.
+struct DetectionBudget
+{
+    size_t max_contours = 0; // Количество контуров, анализируемых по кривизне.
+    int64 max_time = 0; // Время анализа контуров по кривизне в микросекундах.
+};
+
 class HandDetector
 {
 public:
+    HandDetector();
+
     // Отслеживание перемещения рук на изображении.
     void trace(cv::InputArray BinaryImage);
     // Обнаружение новых рук на изображении.
@@ -22,17 +54,97 @@ public:
     void printHands(cv::InputArray Image) const;
     // Возвращает список обнаруженных рук.
     const std::list<Hand>& getHands() const;
+    // Задаёт параметры отбора контуров и сбрасывает счётчики.
+    void setContourFilter(const ContourFilter& filter);
+    // Количество контуров, прошедших отбор и отброшенных им,
+    // с момента задания параметров.
+    uint64 getAcceptedContours() const;
+    uint64 getRejectedContours() const;
+    // Включает инкрементальную обработку: кадр сравнивается с предыдущим
+    // блоками tile_size x tile_size, и контуры, не задевающие изменившиеся
+    // блоки, вместе со сглаженными точками и кривизной берутся с прошлого
+    // кадра. tile_size = 0 отключает инкрементальную обработку.
+    void setIncremental(int tile_size);
+    // Количество контуров, взятых с прошлого кадра, с момента включения.
+    uint64 getReusedContours() const;
+    // Задаёт ограничение работы на кадр и сбрасывает счётчики ограничения.
+    // Прошедшие отбор контуры анализируются в порядке убывания оценки,
+    // зависящей от длины контура и близости к недавно потерянным рукам.
+    void setDetectionBudget(const DetectionBudget& budget);
+    // Количество кадров, на которых ограничение прервало анализ, и количество
+    // не проанализированных из-за него контуров.
+    uint64 getBudgetCuts() const;
+    uint64 getSkippedContours() const;
+    // Задаёт длины хорд, для которых вычисляется кривизна контуров. Рука
+    // ищется по кривизне для каждой длины по порядку, что позволяет находить
+    // руки разного видимого размера. По умолчанию используется одна хорда длины 75.
+    void setChordLengths(const std::vector<int>& chord_lengths);
+    // Контуры из min_points и более точек сглаживаются скользящим средним
+    // вместо ДПФ, 0 - всегда использовать ДПФ.
+    void setSpatialSmoothing(size_t min_points);
 
 private:
-    // Обновление маски рук.
-    void updateMask(cv::Size size);
+    // Обновление списка областей, занятых найденными руками.
+    void updateExcluded();
+    // Проверка контура по характеристикам его цепного кода, box -
+    // ограничивающий прямоугольник прошедшего отбор контура.
+    bool acceptContour(const Contour& contour, cv::Rect& box) const;
+    // Оценка очерёдности анализа контура.
+    double getScore(size_t points, const cv::Rect& box) const;
+
+    // Результаты обработки контура, которые можно взять на следующем кадре.
+    struct ContourAnalysis
+    {
+        bool accepted; // Контур прошёл отбор.
+        bool analysed; // Точки и кривизна вычислены.
+        cv::Rect box; // Ограничивающий прямоугольник.
+        std::vector<cv::Point2f> points; // Сглаженные точки контура.
+        std::vector<std::vector<float>> curvature; // Кривизна для каждой длины хорды.
+    };
 
     // Список обнаруженных рук.
     std::list<Hand> hands_;
-    // Маска рук.
-    cv::Mat mask_;
+    // Области, занятые найденными руками.
+    std::vector<cv::Rect> excluded_;
     // Пирамида изображений с предыдущего кадра.
     std::vector<cv::Mat> prev_pyr_;
+    // Контуры текущего кадра и результаты их обработки.
+    ContourStore contours_;
+    std::vector<ContourAnalysis> analysis_;
+    // Точки обрабатываемого контура и их сглаживание.
+    std::vector<cv::Point2i> contour_points_;
+    ContourSmoother smoother_;
+    // Вычислитель кривизны контуров и длины хорд, для которых она вычисляется.
+    CurvatureEngine curvature_engine_;
+    std::vector<int> chord_lengths_;
+    // Параметры отбора контуров.
+    ContourFilter filter_;
+    uint64 accepted_contours_; // Количество контуров, прошедших отбор.
+    uint64 rejected_contours_; // Количество отброшенных контуров.
+
+    // Данные инкрементальной обработки.
+    int tile_size_; // Размер блока, 0 - обработка каждого кадра заново.
+    cv::Mat prev_image_; // Изображение предыдущего кадра.
+    std::vector<cv::Rect> prev_excluded_; // Исключённые области предыдущего кадра.
+    ContourStore prev_contours_; // Контуры предыдущего кадра.
+    std::vector<ContourAnalysis> prev_analysis_;
+    cv::Mat changed_tiles_; // Карта изменившихся блоков.
+    uint64 reused_contours_; // Количество контуров, взятых с прошлого кадра.
+
+    // Рука, потерянная при отслеживании.
+    struct LostHand
+    {
+        cv::Rect box; // Последнее положение руки.
+        int frames; // Количество кадров с момента потери.
+    };
+
+    // Данные ограничения работы на кадр.
+    DetectionBudget budget_;
+    std::list<LostHand> lost_hands_;
+    std::vector<int> candidates_; // Номера контуров в порядке анализа.
+    std::vector<double> scores_; // Оценки контуров.
+    uint64 budget_cuts_; // Количество кадров, прерванных ограничением.
+    uint64 skipped_contours_; // Количество не проанализированных контуров.
 };
 
 #endif // __HANDDETECTOR_H__